@@ -0,0 +1,256 @@
+#include "BatchRectifier.h"
+#include <fstream>
+#include <set>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+typedef chrono::steady_clock Clock;
+
+static double elapsed(Clock::time_point& t)
+{
+	Clock::time_point now = Clock::now();
+	double ms = chrono::duration<double, milli>(now - t).count();
+	t = now;
+	return ms;
+}
+
+// One mip level for the whole page, the least shrunk part decides so nothing is overblurred
+static int pageLevel(const PerspectiveTransform& H, int width, int height, CImg<uchar>& source)
+{
+	float lo, hi;
+	footprintRange(H, width, height, lo, hi);
+	int level = 0;
+	for (; lo >= 2 && source.width() > 1 && source.height() > 1; lo /= 2, ++level)
+		source = halfSize(source);
+	return level;
+}
+
+static bool isImageFile(const string& file)
+{
+	const char *ext = cimg::split_filename(file.c_str());
+	return !cimg::strcasecmp(ext, "bmp") || !cimg::strcasecmp(ext, "jpg") || !cimg::strcasecmp(ext, "jpeg") ||
+		!cimg::strcasecmp(ext, "png") || !cimg::strcasecmp(ext, "ppm") || !cimg::strcasecmp(ext, "pgm");
+}
+
+BatchRectifier::BatchRectifier(const string& dir, int n)
+{
+	outputDir = dir;
+	threads = n > 0 ? n : max(1u, thread::hardware_concurrency());
+	pageWidth = 595;
+	pageHeight = 842;
+	edgeInput = false;
+	warpThreads = 1;
+	cacheRemap = false;
+	cacheProbe = 8;
+	cacheMinHitRate = 0.25;
+	cacheOff = false;
+	cornerScale = 4;
+	antialias = true;
+	binarize = false;
+}
+
+vector<string> BatchRectifier::collectInputs(const string& path)
+{
+	vector<string> files;
+	if (cimg::is_directory(path.c_str())) {
+		CImgList<char> list = cimg::files(path.c_str(), false, 0, true);
+		cimglist_for(list, i) {
+			string file = list[i]._data;
+			if (isImageFile(file))
+				files.push_back(file);
+		}
+		sort(files.begin(), files.end());
+	}
+	else if (isImageFile(path)) {
+		files.push_back(path);
+	}
+	else {		//Text file, one image per line
+		ifstream in(path.c_str());
+		string line;
+		while (getline(in, line)) {
+			line.erase(line.find_last_not_of(" \t\r") + 1);
+			if (!line.empty())
+				files.push_back(line);
+		}
+	}
+	return files;
+}
+
+// Base name of every input; a name taken by an earlier input gets _2, _3, ... before its extension
+vector<string> BatchRectifier::outputNames(const vector<string>& files)
+{
+	vector<string> names;
+	set<string> taken;
+	for (auto& file : files) {
+		string name = cimg::basename(file.c_str());
+		if (taken.count(name)) {
+			size_t dot = name.find_last_of('.');
+			string stem = name.substr(0, dot), ext = dot == string::npos ? "" : name.substr(dot);
+			for (int n = 2; taken.count(name); ++n)
+				name = stem + "_" + to_string(n) + ext;
+		}
+		taken.insert(name);
+		names.push_back(name);
+	}
+	return names;
+}
+
+bool BatchRectifier::makeDirectory(const string& path)
+{
+	if (path.empty() || cimg::is_directory(path.c_str()))
+		return true;
+	size_t slash = path.find_last_of("/\\");
+	if (slash != string::npos && slash > 0 && !makeDirectory(path.substr(0, slash)))
+		return false;
+#ifdef _WIN32
+	_mkdir(path.c_str());
+#else
+	mkdir(path.c_str(), 0777);
+#endif
+	return cimg::is_directory(path.c_str());
+}
+
+// Tables snap the corners to the cache grid and cost more than a direct warp to build, so the cache is only
+// worth it while pages keep hitting it; after cacheProbe lookups at a low hit rate the batch warps directly
+bool BatchRectifier::useRemapCache()
+{
+	if (!cacheRemap || cacheOff)
+		return false;
+	size_t lookups;
+	double rate = remapCache.hitRate(lookups);
+	if (lookups >= cacheProbe && rate < cacheMinHitRate)
+		cacheOff = true;
+	return !cacheOff;
+}
+
+PageTiming BatchRectifier::rectify(const string& file, const string& out)
+{
+	PageTiming t;
+	t.file = file;
+	Clock::time_point start = Clock::now(), now = start;
+
+	try {
+		CImg<uchar> img(file.c_str());
+		t.load = elapsed(now);
+
+		Hough hough(img);
+		bool found;
+		if (!edgeInput && cornerScale > 1) {	//Edges, voting and corners all happen inside
+			found = hough.findCornersCoarseToFine(cornerScale);
+			t.coarse = hough.coarse_ms;
+			t.refine = hough.refine_ms;
+			t.corners = max(0.0, elapsed(now) - t.coarse - t.refine);
+		}
+		else {
+			if (edgeInput)
+				hough.setEdges(img.get_norm().normalize(0, 255));
+			else
+				hough.detectEdges();
+			t.edge = elapsed(now);
+
+			hough.houghSpaceTransform();
+			hough.houghLinesDetect();
+			t.hough = elapsed(now);
+
+			found = hough.findCorners();
+			t.corners = elapsed(now);
+		}
+
+		if (found) {
+			CImg<uchar> page;
+			PerspectiveTransform transform;
+			const bool cached = useRemapCache();
+			if (binarize && !cached) {
+				// Warped and thresholded band by band, the gray page is never stored; timed as binarize
+				PerspectiveTransform H = transform.pageTransform(hough.vertex, pageWidth, pageHeight);
+				CImg<uchar> source = img;
+				if (antialias)
+					H = PerspectiveTransform(H.matrix().compose(mipScale(pageLevel(H, pageWidth, pageHeight, source))));
+				page = binarizer.warpBinarize(source, H, pageWidth, pageHeight, warpThreads);
+				t.binarize = elapsed(now);
+			}
+			else {
+				if (cached) {
+					int level = 0;
+					CImg<uchar> source = img;
+					if (antialias)
+						level = pageLevel(transform.pageTransform(hough.vertex, pageWidth, pageHeight), pageWidth, pageHeight, source);
+					remapCache.get(hough.vertex, img.width(), img.height(), pageWidth, pageHeight, warpThreads, level)
+						->apply(source, page, warpThreads);
+				}
+				else {
+					page = transform.getTransform(img, hough.vertex, pageWidth, pageHeight, warpThreads, antialias);
+				}
+				t.warp = elapsed(now);
+
+				if (binarize) {
+					page = binarizer.binarize(page, warpThreads);
+					t.binarize = elapsed(now);
+				}
+			}
+
+			page.save(out.c_str());
+			t.save = elapsed(now);
+			t.ok = true;
+		}
+	}
+	catch (exception&) {	//CImg errors and bad_alloc alike: on a worker thread they would end the batch
+		t.ok = false;
+	}
+
+	t.total = chrono::duration<double, milli>(Clock::now() - start).count();
+	return t;
+}
+
+void BatchRectifier::run(const vector<string>& files)
+{
+	timings.assign(files.size(), PageTiming());
+	cacheOff = false;
+	makeDirectory(outputDir);			//Pages that cannot be saved are reported as failed
+	vector<string> names = outputNames(files);
+	warpThreads = max<size_t>(1, threads / max<size_t>(1, files.size()));	//Cores left over by the page workers
+	atomic<size_t> next(0);
+
+	auto worker = [&]() {
+		for (size_t i = next++; i < files.size(); i = next++)
+			timings[i] = rectify(files[i], outputDir + "/" + names[i]);
+	};
+
+	vector<thread> pool;
+	int n = min<size_t>(threads, files.size());
+	for (int i = 1; i < n; ++i)
+		pool.push_back(thread(worker));
+	worker();
+	for (auto& th : pool)
+		th.join();
+}
+
+void BatchRectifier::report(ostream& os) const
+{
+	PageTiming sum;
+	int ok = 0;
+	for (auto& t : timings) {
+		os << (t.ok ? "ok     " : "failed ") << t.file
+			<< "  load " << t.load << "  edge " << t.edge << "  hough " << t.hough
+			<< "  coarse " << t.coarse << "  refine " << t.refine << "  corners " << t.corners << "  warp " << t.warp << "  binarize " << t.binarize << "  save " << t.save
+			<< "  total " << t.total << " ms" << endl;
+		sum.load += t.load; sum.edge += t.edge; sum.hough += t.hough;
+		sum.coarse += t.coarse; sum.refine += t.refine;
+		sum.corners += t.corners; sum.warp += t.warp; sum.binarize += t.binarize; sum.save += t.save;
+		sum.total += t.total;
+		ok += t.ok;
+	}
+	if (timings.empty())
+		return;
+
+	double n = timings.size();
+	os << ok << " / " << timings.size() << " pages rectified, " << threads << " threads";
+	if (cacheRemap)
+		os << ", remap cache " << remapCache.hits << " hits / " << remapCache.misses << " misses" << (cacheOff ? ", switched off" : "");
+	os << endl;
+	os << "average  load " << sum.load / n << "  edge " << sum.edge / n << "  hough " << sum.hough / n
+		<< "  coarse " << sum.coarse / n << "  refine " << sum.refine / n << "  corners " << sum.corners / n << "  warp " << sum.warp / n << "  binarize " << sum.binarize / n << "  save " << sum.save / n
+		<< "  total " << sum.total / n << " ms" << endl;
+}
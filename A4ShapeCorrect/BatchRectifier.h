@@ -0,0 +1,57 @@
+#pragma once
+#include "Hough.h"
+#include "PerspectiveTransform.h"
+#include "RemapCache.h"
+#include "Binarizer.h"
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+// Time spent on one page, in milliseconds
+struct PageTiming {
+	string file;
+	bool ok;
+	double load, edge, hough, coarse, refine, corners, warp, binarize, save;
+	double total;
+	PageTiming() {
+		ok = false;
+		load = edge = hough = coarse = refine = corners = warp = binarize = save = total = 0;
+	}
+};
+
+// Headless document rectification over many pages: load, edges, Hough, corners, warp, binarize, save.
+// Pages are independent and shared between worker threads, nothing is displayed.
+class BatchRectifier
+{
+public:
+	string outputDir;
+	int threads;
+	int warpThreads;				//Threads of one page warp
+	int pageWidth, pageHeight;		//Size of the rectified page, A4 ratio
+	bool edgeInput;					//Inputs are already edge maps
+	int cornerScale;				//Downsampling of the coarse-to-fine corner search, 1 votes at full resolution
+	bool cacheRemap;				//Reuse remap tables between pages at the same pose, for fixed camera batches
+	size_t cacheProbe;				//Lookups after which a remap cache with a low hit rate is switched off
+	double cacheMinHitRate;
+	bool antialias;					//Prefilter through a mip pyramid when the page is shrunk
+	bool binarize;					//Save the page thresholded for OCR, warped band by band unless cacheRemap
+	AdaptiveBinarizer binarizer;
+	RemapCache remapCache;
+
+	vector<PageTiming> timings;
+
+private:
+	atomic<bool> cacheOff;			//The cache missed too often in this batch
+
+	bool useRemapCache();
+
+public:
+	BatchRectifier(const string& outputDir, int threads = 0);
+
+	static vector<string> collectInputs(const string& path);	//Directory, list file or a single image
+	static vector<string> outputNames(const vector<string>& files);	//Base names, made unique
+	static bool makeDirectory(const string& path);				//Create path and its parents
+	PageTiming rectify(const string& file, const string& output);	//Output path of the page
+	void run(const vector<string>& files);
+	void report(ostream& os = cout) const;
+};
@@ -0,0 +1,118 @@
+#include "Binarizer.h"
+
+typedef unsigned long long uint64;
+
+// Channel mean, the image itself when it is already gray
+static CImg<uchar> toGray(const CImg<uchar>& img)
+{
+	if (img.spectrum() == 1)
+		return img;
+	const int n = img.spectrum();
+	CImg<uchar> gray(img.width(), img.height());
+	vector<int> sum(img.width());
+	cimg_forY(img, y) {
+		fill(sum.begin(), sum.end(), n / 2);
+		cimg_forC(img, c) {
+			const uchar* row = img.data(0, y, 0, c);
+			cimg_forX(img, x)
+				sum[x] += row[x];
+		}
+		uchar* out = gray.data(0, y);
+		cimg_forX(img, x)
+			out[x] = (uchar)(sum[x] / n);
+	}
+	return gray;
+}
+
+AdaptiveBinarizer::AdaptiveBinarizer(Method m, int w, double kk)
+{
+	method = m;
+	window = w | 1;
+	k = kk;
+	range = 128;
+}
+
+// gray holds the page rows top .. top + gray.height() - 1, out gets rows y0 .. y1 - 1
+void AdaptiveBinarizer::binarizeBand(const CImg<uchar>& gray, int top, int y0, int y1, CImg<uchar>& out) const
+{
+	const int w = gray.width(), h = gray.height(), r = window / 2;
+	const int stride = w + 1;
+
+	// Integral images over the rows from the first one the band needs, kept in a ring of
+	// window + 1 rows since a window never spans more. The plain sums wrap around in 32 bits,
+	// window sums taken as differences are still exact since they always fit.
+	const int ring = window + 1;
+	vector<unsigned> sum((size_t)stride * ring, 0);
+	vector<uint64> sq((size_t)stride * ring, 0);
+	int built = max(y0 - r, top) - top;		//Integral rows up to this one are ready, this one is zero
+
+	const double kr = k / range;
+	for (int y = y0; y < y1; ++y) {
+		// Window rows clamped to the page, then to the band
+		const int a = max(y - r, top) - top, b = min(y + r + 1, top + h) - top;
+		for (; built < b; ++built) {
+			const uchar* src = gray.data(0, built);
+			const unsigned* sp = &sum[(size_t)(built % ring) * stride];
+			const uint64* qp = &sq[(size_t)(built % ring) * stride];
+			unsigned* s = &sum[(size_t)((built + 1) % ring) * stride];
+			uint64* q = &sq[(size_t)((built + 1) % ring) * stride];
+			unsigned rs = 0;
+			uint64 rq = 0;
+			for (int x = 0; x < w; ++x) {
+				rs += src[x];
+				rq += src[x] * src[x];
+				s[x + 1] = sp[x + 1] + rs;
+				q[x + 1] = qp[x + 1] + rq;
+			}
+		}
+
+		const uchar* row = gray.data(0, y - top);
+		uchar* dst = out.data(0, y);
+		const unsigned *sa = &sum[(size_t)(a % ring) * stride], *sb = &sum[(size_t)(b % ring) * stride];
+		const uint64 *qa = &sq[(size_t)(a % ring) * stride], *qb = &sq[(size_t)(b % ring) * stride];
+		for (int x = 0; x < w; ++x) {
+			const int l = max(x - r, 0), rr = min(x + r + 1, w);
+			const double n = (double)(b - a) * (rr - l);
+			const double mean = (sb[rr] - sb[l] - sa[rr] + sa[l]) / n;
+			// Black when the pixel is at most the threshold
+			const double excess = row[x] - mean * (1 - k);
+			bool black;
+			if (method == SAUVOLA) {
+				// excess <= mean * k / range * deviation, squared to avoid the root
+				const double variance = (double)(qb[rr] - qb[l] - qa[rr] + qa[l]) / n - mean * mean;
+				const double slope = mean * kr;
+				black = excess <= 0 || excess * excess <= slope * slope * variance;
+			}
+			else {
+				black = excess <= 0;
+			}
+			dst[x] = black ? 0 : 255;
+		}
+	}
+}
+
+CImg<uchar> AdaptiveBinarizer::binarize(const CImg<uchar>& page, int threads) const
+{
+	const CImg<uchar> gray = toGray(page);
+	CImg<uchar> out(gray.width(), gray.height());
+	parallelRows(gray.height(), threads, [&](int y0, int y1) {
+		binarizeBand(gray, 0, y0, y1, out);
+	});
+	return out;
+}
+
+CImg<uchar> AdaptiveBinarizer::warpBinarize(const CImg<uchar>& src, const PerspectiveTransform& H, int width, int height,
+	int threads) const
+{
+	CImg<uchar> out(width, height);
+	const int r = window / 2;
+	parallelRows(height, threads, [&](int y0, int y1) {
+		// Band plus halo, warped with the rows shifted so that local row 0 is page row a
+		const int a = max(0, y0 - r), b = min(height, y1 + r);
+		const PerspectiveTransform band(H.matrix() * Matrix3(1, 0, 0, 0, 1, (float)a, 0, 0, 1));
+		CImg<uchar> local(width, b - a, 1, src.spectrum());
+		warpPerspective(src, band, local, 1);
+		binarizeBand(toGray(local), a, y0, y1, out);
+	});
+	return out;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include "PerspectiveWarp.h"
+
+// Adaptive thresholding of a rectified page from integral and squared integral images, so a
+// pixel costs the same for any window size. Rows are split into bands, each band builds the
+// integrals of its rows plus half a window above and below, so bands are independent and can
+// be binarized right after they are warped.
+class AdaptiveBinarizer
+{
+public:
+	enum Method {
+		SAUVOLA,	//Threshold mean * (1 + k * (deviation / range - 1))
+		BRADLEY		//Threshold mean * (1 - k)
+	};
+
+	Method method;
+	int window;			//Side of the square neighbourhood, odd
+	double k;
+	double range;		//Dynamic range of the deviation, Sauvola only
+
+public:
+	AdaptiveBinarizer(Method method = SAUVOLA, int window = 31, double k = 0.34);
+
+	// Black (0) text on white (255); colour pages are thresholded on the channel mean
+	CImg<uchar> binarize(const CImg<uchar>& page, int threads = 0) const;
+
+	// Warp a width x height page through H and binarize it band by band, without the full
+	// gray page ever being stored
+	CImg<uchar> warpBinarize(const CImg<uchar>& src, const PerspectiveTransform& H, int width, int height,
+		int threads = 0) const;
+
+private:
+	void binarizeBand(const CImg<uchar>& gray, int top, int y0, int y1, CImg<uchar>& out) const;
+};
@@ -0,0 +1,68 @@
+#include "CornerTracker.h"
+
+CornerTracker::CornerTracker(int s) : hough(CImg<uchar>())
+{
+	scale = s;
+	reset();
+}
+
+void CornerTracker::reset()
+{
+	sides.clear();
+	vertex.clear();
+	tracking = false;
+	frames = tracked = redetected = 0;
+	lo = 0;
+	gain = 1;
+}
+
+bool CornerTracker::update(const CImg<uchar>& frame)
+{
+	++frames;
+	hough.setImage(frame);
+	if (tracking && verify()) {
+		++tracked;
+		return true;
+	}
+	++redetected;
+	tracking = detect();
+	return tracking;
+}
+
+bool CornerTracker::detect()
+{
+	if (!hough.findCornersCoarseToFine(scale) || hough.sides.size() != 4)
+		return false;
+	sides = hough.sides;
+	vertex = hough.vertex;
+	lo = hough.gray_lo;
+	gain = hough.gray_gain;
+	return true;
+}
+
+bool CornerTracker::verify()
+{
+	hough.sides.clear();
+	for (auto& side : sides) {
+		// Length of the side between the two corners lying on it
+		vector<pair<double, int>> dist;
+		for (size_t i = 0; i < vertex.size(); ++i)
+			dist.push_back(make_pair(fabs(vertex[i].first * cos(side.angle) + vertex[i].second * sin(side.angle) - side.rho), i));
+		sort(dist.begin(), dist.end());
+		const pair<int, int> &a = vertex[dist[0].second], &b = vertex[dist[1].second];
+		const double length = sqrt(pow(a.first - b.first, 2) + pow(a.second - b.second, 2));
+
+		PolarLine fitted(0, 0);
+		int votes = 0;
+		if (!hough.refineLine(side, track_band, track_angle, lo, gain, fitted, votes) || votes < min_support * length)
+			return false;
+		hough.sides.push_back(fitted);
+	}
+
+	hough.intersectSides();
+	if (!hough.pickCorners())
+		return false;
+	sides = hough.sides;
+	vertex = hough.vertex;
+	return true;
+}
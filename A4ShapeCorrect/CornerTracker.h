@@ -0,0 +1,34 @@
+#pragma once
+#include "Hough.h"
+
+// Page corners of a live capture. The four sides of the last quad are checked on every frame
+// by refitting each one to the edges of a narrow strip around it; only when a side is no longer
+// supported does the tracker fall back to the coarse-to-fine Hough search.
+class CornerTracker
+{
+public:
+	int scale;						//Downsampling of the full search
+	int track_band = 12;			//Half width of the strip a side may move in between frames
+	double track_angle = 1 * cimg::PI / 180;	//Rotation a side may make between frames
+	double min_support = 0.5;		//Share of a side that must lie on edges
+
+	vector<PolarLine> sides;		//Sides of the current quad
+	vector<pair<int, int>> vertex;	//Corners: top-left, top-right, bottom-left, bottom-right
+	bool tracking;
+
+	int frames, tracked, redetected;	//Frames seen, verified cheaply, searched again
+
+private:
+	double lo, gain;				//Gray level mapping of the last full search
+	Hough hough;					//Holds the current frame, its buffers reused from frame to frame
+
+public:
+	CornerTracker(int scale = 4);
+
+	bool update(const CImg<uchar>& frame);		//False when no page is found
+	void reset();
+
+private:
+	bool verify();
+	bool detect();
+};
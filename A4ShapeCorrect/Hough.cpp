@@ -1,29 +1,54 @@
 
 #include "Hough.h"
+#include <chrono>
 
 
-Hough::Hough(string filename) {
-	img.load(filename.c_str());
+Hough::Hough(const CImg<uchar>& image) {
+	setImage(image);
+	result = img;
+}
 
+void Hough::setImage(const CImg<uchar>& image)
+{
+	img = image;	//Same size as before: copied into the buffer already held
 	width = img.width();
 	height = img.height();
 	max_length = sqrt(pow(width, 2) + pow(height, 2));
+	sides.clear();
+	vertex.clear();
+}
 
-	/*gFiltered = img.get_norm().normalize(0, 255);
-	gFiltered.blur(5);
-	Prewitt();*/
-	//sobel();
-	gradnum = img;
-	houghSpaceTransform();
-	houghLinesDetect();
-	drawLines();
-	drawPoints();
-	result.save("res.bmp");
+void Hough::setEdges(const CImg<uchar>& edge)
+{
+	gradnum = edge;
+}
 
+void Hough::detectEdges(double sigma)
+{
+	gFiltered = img.get_norm().normalize(0, 255);
+	gFiltered.blur(sigma);
+	Prewitt();
+}
 
-	/*houghCircleTransform();
-	result.save("./result2/2.bmp");*/
+CImg<uchar> prewittEdges(const CImg<float>& smoothed, double gradLimit)
+{
+	CImg<uchar> edge(smoothed.width(), smoothed.height(), 1, 1, 0);
+	// 3x3 neighbourhood I
+	CImg_3x3(I, double);
+	cimg_for3x3(smoothed, x, y, 0, 0, I, double) {
+		const double ix = Inc - Ipc;
+		const double iy = Icp - Icn;
+		double grad = std::sqrt(ix*ix + iy * iy);
+		if (grad > gradLimit) {
+			edge(x, y) = grad > 255 ? 255 : grad;
+		}
+	}
+	return edge;
+}
 
+void Hough::Prewitt()
+{
+	gradnum = prewittEdges(gFiltered, gradLimit);
 }
 
 void Hough::houghSpaceTransform()
@@ -32,7 +57,7 @@ void Hough::houghSpaceTransform()
 
 	cimg_forXY(gradnum, x, y) {
 		int temp = gradnum(x, y);
-		if (temp != 0&&y>2&&y<1000) {
+		if (temp != 0 && x >= border && x < width - border && y >= border && y < height - border) {
 			for (int i = 0; i < theta; ++i) {
 				double r = x * cos(i*interval) + y * sin(i*interval);
 				if (r >= 0 && r < max_length) {
@@ -65,14 +90,12 @@ void Hough::houghLinesDetect()
 			}
 		}
 	}
-	cout << peaks.size() << endl;
-
 }
 
 void Hough::drawLines()
 {
 	lines.clear();
-	for (int i = 0; i < peaks.size(); i++) {
+	for (size_t i = 0; i < peaks.size(); i++) {
 		double theta = double(peaks[i].x)*interval;
 		double k = -cos(theta) / sin(theta); // ֱб
 		if (peaks[i].x == 90 || peaks[i].x == 270)
@@ -87,7 +110,7 @@ void Hough::drawLines()
 	result = img;
 
 	const double lines_color[] = { 0, 0, 255 };
-	for (int i = 0; i < lines.size(); i++) {
+	for (size_t i = 0; i < lines.size(); i++) {
 		const int x0 = (y_min - lines[i].b) / lines[i].k;
 		const int x1 = (y_max - lines[i].b) / lines[i].k;
 		const int x = peaks[i].y / cos(peaks[i].x*interval);
@@ -110,37 +133,278 @@ void Hough::drawLines()
 	}
 }
 
-void Hough::drawPoints()
+void Hough::intersectLines()
 {
-	for (int i = 0; i < peaks.size(); ++i) {
-		cout << "vote: " << houghImage(peaks[i].x, peaks[i].y) << endl;
-		cout << "angle: " << peaks[i].x << " " << peaks[i].y << endl;
-
+	points.clear();
+	for (size_t i = 0; i < peaks.size(); ++i) {
 		double angle = peaks[i].x*interval;
 		double a0 = cos(angle), b0 = sin(angle), c0 = -peaks[i].y;
-		//cout <<"Peaks "<< peaks[i].x << " "<<peaks[i].y << endl;
 		if (peaks[i].x == 90)
 			a0 = 0;
-		cout << "Line" << i << ": ( " << a0 << " ) x + (" << b0 << ") y + ( " << c0 << " ) = 0" << endl;
 
-		for (int j = i + 1; j < peaks.size(); ++j) {
+		for (size_t j = i + 1; j < peaks.size(); ++j) {
 			double angle1 = peaks[j].x*interval;
 			double a1 = cos(angle1), b1 = sin(angle1), c1 = -peaks[j].y;
 			if (peaks[j].x == 90 || peaks[j].x == 270)
 				a1 = 0;
 			double D = a0 * b1 - a1 * b0;
-			//cout << "D " << D <<" "<< a0 * b1 << " " << a1 * b0 << endl;
 			if (D != 0) {
 				int x = (b0*c1 - b1 * c0) / D;
 				int y = (a1*c0 - a0 * c1) / D;
-				//cout <<"P"<< (b0*c1 - b1 * c0) / D << endl;
 				if (x > 0 && x < width - 1 && y>0 && y < height - 1) {
+					points.push_back(Point(x, y));
+				}
+			}
+		}
+	}
+}
+
+// Page corners from the line intersections, extreme along the two diagonals
+bool Hough::findCorners()
+{
+	intersectLines();
+	return pickCorners();
+}
+
+bool Hough::pickCorners()
+{
+	vertex.clear();
+	if (points.size() < 4)
+		return false;
+
+	Point tl = points[0], tr = points[0], bl = points[0], br = points[0];
+	for (auto& p : points) {
+		if (p.x + p.y < tl.x + tl.y) tl = p;
+		if (p.x + p.y > br.x + br.y) br = p;
+		if (p.x - p.y > tr.x - tr.y) tr = p;
+		if (p.x - p.y < bl.x - bl.y) bl = p;
+	}
+	vertex.push_back(make_pair(tl.x, tl.y));
+	vertex.push_back(make_pair(tr.x, tr.y));
+	vertex.push_back(make_pair(bl.x, bl.y));
+	vertex.push_back(make_pair(br.x, br.y));
+	return true;
+}
 
+// Mean of every scale x scale block, the remainder rows and columns are dropped
+static CImg<uchar> boxDownsample(const CImg<uchar>& src, int scale)
+{
+	const int w = src.width() / scale, h = src.height() / scale, area = scale * scale;
+	CImg<uchar> dst(w, h, 1, src.spectrum());
+	vector<int> sum(w);
+	cimg_forC(src, c) {
+		for (int y = 0; y < h; ++y) {
+			fill(sum.begin(), sum.end(), 0);
+			for (int k = 0; k < scale; ++k) {
+				const uchar* row = src.data(0, y * scale + k, 0, c);
+				for (int x = 0; x < w * scale; ++x)
+					sum[x / scale] += row[x];
+			}
+			for (int x = 0; x < w; ++x)
+				dst(x, y, 0, c) = (uchar)((sum[x] + area / 2) / area);
+		}
+	}
+	return dst;
+}
+
+// Page lines on a downsampled copy, then every line refined at full resolution from the edges
+// of a narrow strip around it only
+bool Hough::findCornersCoarseToFine(int scale)
+{
+	typedef chrono::steady_clock Clock;
+	Clock::time_point start = Clock::now();
+	Hough coarse(boxDownsample(img, scale));
+	coarse.min_votes = min_votes / scale;
+	coarse.detectEdges(max(1.0, min(5.0, 20.0 / scale)));	//About 20 full resolution pixels, wide enough to wash out text
+	coarse.houghSpaceTransform();
+	coarse.houghLinesDetect();
+
+	// Gray levels of the strips mapped like detectEdges() maps the whole image
+	CImg<float> gray = coarse.img.get_norm();
+	const float lo = gray.min(), hi = gray.max();
+	const double gain = hi > lo ? 255.0 / (hi - lo) : 0;
+	gray_lo = lo;
+	gray_gain = gain;
+	Clock::time_point refined = Clock::now();
+	coarse_ms = chrono::duration<double, milli>(refined - start).count();
+
+	// Strongest lines first, each refined once; a page has four sides
+	vector<Point> order = coarse.peaks;
+	sort(order.begin(), order.end(), [&](const Point& a, const Point& b) {
+		return coarse.houghImage(a.x, a.y) > coarse.houghImage(b.x, b.y);
+	});
+	sides.clear();
+	for (auto& p : order) {
+		if (sides.size() == 4)
+			break;
+		const double angle = p.x * interval, rho = (p.y + 0.5) * scale;
+		bool known = false;
+		for (auto& s : sides) {
+			if (cos(s.angle - angle) > cos(2 * refine_angle) && fabs(s.rho - rho) < refineBand(scale))
+				known = true;
+		}
+		PolarLine side(0, 0);
+		if (known || !refineSide(p, scale, lo, gain, side))
+			continue;
+		// Neighbouring coarse peaks of one thick edge refine to the same side
+		for (auto& s : sides) {
+			if (cos(s.angle - side.angle) > cos(2 * refine_angle) && fabs(s.rho - side.rho) < refineBand(scale))
+				known = true;
+		}
+		if (!known)
+			sides.push_back(side);
+	}
+	refine_ms = chrono::duration<double, milli>(Clock::now() - refined).count();
+	intersectSides();
+	return pickCorners();
+}
+
+// Half width of the strip around a coarse line: rho is known to a coarse pixel, the angle to
+// refine_angle over half the diagonal
+int Hough::refineBand(int scale) const
+{
+	return 2 * scale + (int)ceil(0.5 * max_length * sin(refine_angle));
+}
+
+bool Hough::refineSide(const Point& peak, int scale, double lo, double gain, PolarLine& side)
+{
+	int votes = 0;
+	return refineLine(PolarLine(peak.x * interval, (peak.y + 0.5) * scale), refineBand(scale), refine_angle,
+		lo, gain, side, votes) && votes >= min_votes;
+}
+
+// Fit the edges of a strip of half width band around guess, searching angles within range of it.
+// votes is the count of the best (angle, rho) bin, about the length of edge on the line.
+bool Hough::refineLine(const PolarLine& guess, int band, double range, double lo, double gain,
+	PolarLine& side, int& votes)
+{
+	const double angle0 = guess.angle, rho0 = guess.rho;
+	const double c0 = cos(angle0), s0 = sin(angle0);
+
+	// The strip is cut into tiles along the line, so a tilted line only costs about its length
+	// times (tile + band) pixels rather than its whole bounding box. Each tile is padded for the
+	// blur and keeps the edge points of its own span of the major axis only.
+	const int pad = 15, tile = 256;
+	const bool horizontal = fabs(s0) > fabs(c0);	//Closer to horizontal, y as a function of x
+	const int length = horizontal ? width : height;
+	vector<double> ex, ey, ew;
+	for (int t0 = 0; t0 < length; t0 += tile) {
+		const int t1 = min(length, t0 + tile) - 1;
+		// Span of the line across the tile, in the minor axis
+		const double m0 = horizontal ? (rho0 - t0 * c0) / s0 : (rho0 - t0 * s0) / c0;
+		const double m1 = horizontal ? (rho0 - t1 * c0) / s0 : (rho0 - t1 * s0) / c0;
+		const int lo0 = (int)floor(min(m0, m1)) - band - pad, hi0 = (int)ceil(max(m0, m1)) + band + pad;
+		int x0, y0, x1, y1;
+		if (horizontal) {
+			x0 = max(0, t0 - pad); x1 = min(width - 1, t1 + pad);
+			y0 = max(0, lo0); y1 = min(height - 1, hi0);
+		}
+		else {
+			y0 = max(0, t0 - pad); y1 = min(height - 1, t1 + pad);
+			x0 = max(0, lo0); x1 = min(width - 1, hi0);
+		}
+		if (x0 >= x1 || y0 >= y1)
+			continue;
+
+		// Edge map of the tile, same pipeline as detectEdges()
+		CImg<float> smoothed = img.get_crop(x0, y0, x1, y1).get_norm();
+		smoothed -= lo;
+		smoothed *= gain;
+		smoothed.blur(5);
+		CImg<uchar> edge = prewittEdges(smoothed, gradLimit);
+
+		cimg_forXY(edge, x, y) {
+			const int gx = x + x0, gy = y + y0;
+			const int major = horizontal ? gx : gy;
+			if (edge(x, y) == 0 || major < t0 || major > t1 ||
+				gx < border || gx >= width - border || gy < border || gy >= height - border)
+				continue;
+			if (fabs(gx * c0 + gy * s0 - rho0) <= band) {
+				ex.push_back(gx);
+				ey.push_back(gy);
+				ew.push_back(edge(x, y));
+			}
+		}
+	}
+	if (ex.empty())
+		return false;
+
+	// Fine voting: angles around the guess, rho in 1 pixel bins across the band
+	const int steps = (int)(range / refine_step + 0.5);
+	const int rhoBins = 2 * band + 1;
+	CImg<int> fine(2 * steps + 1, rhoBins, 1, 1, 0);
+	for (int a = -steps; a <= steps; ++a) {
+		const double angle = angle0 + a * refine_step;
+		const double c = cos(angle), s = sin(angle);
+		for (size_t i = 0; i < ex.size(); ++i) {
+			const int r = (int)floor(ex[i] * c + ey[i] * s - rho0 + band + 0.5);
+			if (r >= 0 && r < rhoBins)
+				fine(a + steps, r)++;		//voting
+		}
+	}
+	int best = 0, ba = 0, br = 0;
+	cimg_forXY(fine, a, r) {
+		if (fine(a, r) > best) {
+			best = fine(a, r);
+			ba = a; br = r;
+		}
+	}
+	votes = best;
+	if (best == 0)
+		return false;
+
+	// Gradient weighted least squares fit of the edge band around the voted line; the blurred
+	// edge is about 4 sigma wide, so the window takes all of it
+	const double angle = angle0 + (ba - steps) * refine_step;
+	const double c = cos(angle), s = sin(angle), rho = rho0 + br - band;
+	const double window = 10;
+	double n = 0, mx = 0, my = 0;
+	for (size_t i = 0; i < ex.size(); ++i) {
+		if (fabs(ex[i] * c + ey[i] * s - rho) <= window) {
+			n += ew[i]; mx += ew[i] * ex[i]; my += ew[i] * ey[i];
+		}
+	}
+	mx /= n; my /= n;
+	double sxx = 0, syy = 0, sxy = 0;
+	for (size_t i = 0; i < ex.size(); ++i) {
+		if (fabs(ex[i] * c + ey[i] * s - rho) <= window) {
+			const double dx = ex[i] - mx, dy = ey[i] - my;
+			sxx += ew[i] * dx * dx; syy += ew[i] * dy * dy; sxy += ew[i] * dx * dy;
+		}
+	}
+	// Normal of the fitted line is the direction of least spread
+	double fit = 0.5 * atan2(2 * sxy, sxx - syy) + cimg::PI / 2;
+	if (cos(fit - angle) < 0)
+		fit += cimg::PI;
+	side = PolarLine(fit, mx * cos(fit) + my * sin(fit));
+	return true;
+}
+
+void Hough::intersectSides()
+{
+	points.clear();
+	for (size_t i = 0; i < sides.size(); ++i) {
+		const double a0 = cos(sides[i].angle), b0 = sin(sides[i].angle);
+		for (size_t j = i + 1; j < sides.size(); ++j) {
+			const double a1 = cos(sides[j].angle), b1 = sin(sides[j].angle);
+			double D = a0 * b1 - a1 * b0;
+			if (fabs(D) > 1e-6) {
+				int x = floor((sides[i].rho * b1 - sides[j].rho * b0) / D + 0.5);
+				int y = floor((a0 * sides[j].rho - a1 * sides[i].rho) / D + 0.5);
+				if (x > 0 && x < width - 1 && y>0 && y < height - 1) {
 					points.push_back(Point(x, y));
 				}
 			}
 		}
 	}
+}
+
+void Hough::drawPoints()
+{
+	for (size_t i = 0; i < peaks.size(); ++i) {
+		cout << "vote: " << houghImage(peaks[i].x, peaks[i].y) << endl;
+		cout << "angle: " << peaks[i].x << " " << peaks[i].y << endl;
+	}
 
 	cout << "Points:" << endl;
 
@@ -149,5 +413,4 @@ void Hough::drawPoints()
 		cout << "( " << c.x << " , " << c.y << " )" << endl;
 		result.draw_circle(c.x, c.y, 5, color);
 	}
-	result.display();
 }
\ No newline at end of file
@@ -0,0 +1,93 @@
+#pragma once
+#include "CImg.h"
+#include <string>
+#include <vector>
+#include <utility>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+using namespace cimg_library;
+using namespace std;
+typedef unsigned char uchar;
+
+struct Point {
+	int x, y;
+	Point(int a, int b) {
+		x = a;
+		y = b;
+	}
+};
+
+// y = k * x + b
+struct Line {
+	double k, b;
+	Line(double a, double c) {
+		k = a;
+		b = c;
+	}
+};
+
+// Line in normal form: x * cos(angle) + y * sin(angle) = rho
+struct PolarLine {
+	double angle, rho;
+	PolarLine(double a, double r) {
+		angle = a;
+		rho = r;
+	}
+};
+
+// Prewitt gradient magnitude of a smoothed gray image, kept where it exceeds gradLimit, clamped to 255
+CImg<uchar> prewittEdges(const CImg<float>& smoothed, double gradLimit = 20);
+
+class Hough
+{
+public:
+	CImg<uchar> img;			//Original Image
+	CImg<float> gFiltered;		//Smoothed grayscale
+	CImg<uchar> gradnum;		//Edge Map
+	CImg<int> houghImage;		//Hough Space
+	CImg<uchar> result;			//Result Image
+
+	int width, height;
+	int max_length;				//Length of the image diagonal
+
+	vector<Point> peaks;		//(theta, rho) of detected lines
+	vector<Line> lines;
+	vector<Point> points;		//Intersection of lines
+	vector<PolarLine> sides;	//Refined lines of the coarse-to-fine mode
+	vector<pair<int, int>> vertex;	//Page corners: top-left, top-right, bottom-left, bottom-right
+
+	const int theta = 360;
+	const double interval = cimg::PI / 180;
+	const double gradLimit = 20;
+	int min_votes = 250;
+	double min_distance = 50;
+	const int border = 3;			//Edge pixels this close to the image border do not vote
+
+	// Coarse-to-fine corners
+	double refine_angle = 1.5 * cimg::PI / 180;	//Angle searched around a coarse line
+	double refine_step = 0.1 * cimg::PI / 180;	//Angle step of the refinement
+	double gray_lo = 0, gray_gain = 1;			//Gray level mapping of the strips, set by the coarse pass
+	double coarse_ms = 0, refine_ms = 0;		//Time of the coarse pass and of the strip refinement
+
+public:
+	Hough(const CImg<uchar>& image);	//Constructor, no file I/O
+	void setImage(const CImg<uchar>&);	//Next frame, reusing the buffers; result is left to drawLines()
+	void setEdges(const CImg<uchar>&);	//Use a precomputed edge map
+	void detectEdges(double sigma = 5);	//Blur and Prewitt edge map of the image
+	void Prewitt();
+	void houghSpaceTransform();
+	double distance(double, double);
+	void houghLinesDetect();
+	void intersectLines();
+	bool findCorners();
+	bool findCornersCoarseToFine(int scale = 4);
+	int refineBand(int scale) const;
+	bool refineSide(const Point& peak, int scale, double lo, double gain, PolarLine& side);
+	bool refineLine(const PolarLine& guess, int band, double range, double lo, double gain, PolarLine& side, int& votes);
+	void intersectSides();
+	bool pickCorners();
+	void drawLines();
+	void drawPoints();
+};
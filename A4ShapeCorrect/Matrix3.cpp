@@ -0,0 +1,40 @@
+#include "Matrix3.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MATRIX3_USE_SSE2
+#endif
+
+Matrix3 Matrix3::inverse() const
+{
+	const Matrix3 adj = adjoint();
+	const float det = determinant();
+	if (det == 0)
+		return adj;
+	const float s = 1 / det;
+	return Matrix3(adj.m[0] * s, adj.m[1] * s, adj.m[2] * s, adj.m[3] * s, adj.m[4] * s, adj.m[5] * s,
+		adj.m[6] * s, adj.m[7] * s, adj.m[8] * s);
+}
+
+void Matrix3::transformPoints(const float* xs, const float* ys, size_t n, float* outX, float* outY) const
+{
+	size_t i = 0;
+#ifdef MATRIX3_USE_SSE2
+	const __m128 m0 = _mm_set1_ps(m[0]), m1 = _mm_set1_ps(m[1]), m2 = _mm_set1_ps(m[2]);
+	const __m128 m3 = _mm_set1_ps(m[3]), m4 = _mm_set1_ps(m[4]), m5 = _mm_set1_ps(m[5]);
+	const __m128 m6 = _mm_set1_ps(m[6]), m7 = _mm_set1_ps(m[7]), m8 = _mm_set1_ps(m[8]);
+	for (; i + 4 <= n; i += 4) {
+		const __m128 x = _mm_loadu_ps(xs + i), y = _mm_loadu_ps(ys + i);
+		const __m128 w = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m6, x), _mm_mul_ps(m7, y)), m8);
+		const __m128 u = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m0, x), _mm_mul_ps(m1, y)), m2);
+		const __m128 v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m3, x), _mm_mul_ps(m4, y)), m5);
+		_mm_storeu_ps(outX + i, _mm_div_ps(u, w));
+		_mm_storeu_ps(outY + i, _mm_div_ps(v, w));
+	}
+#endif
+	for (; i < n; ++i) {
+		const float x = xs[i], y = ys[i];
+		outX[i] = mapX(x, y);
+		outY[i] = mapY(x, y);
+	}
+}
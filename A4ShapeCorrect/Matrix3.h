@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+
+// 3x3 homography as a value type, row major: x' = (m[0] x + m[1] y + m[2]) / (m[6] x + m[7] y + m[8]),
+// y' = (m[3] x + m[4] y + m[5]) / (m[6] x + m[7] y + m[8]).
+// Construction, product and the single point map are constexpr, so fixed transforms can be built
+// at compile time.
+struct Matrix3 {
+	float m[9];
+
+	constexpr Matrix3() : m{ 1, 0, 0, 0, 1, 0, 0, 0, 1 } {}
+	constexpr Matrix3(float m0, float m1, float m2, float m3, float m4, float m5, float m6, float m7, float m8)
+		: m{ m0, m1, m2, m3, m4, m5, m6, m7, m8 } {}
+
+	constexpr float operator()(int r, int c) const { return m[r * 3 + c]; }
+
+	// Matrix product, (A * B) maps a point through B first, then A
+	constexpr Matrix3 operator*(const Matrix3& b) const {
+		return Matrix3(
+			m[0] * b.m[0] + m[1] * b.m[3] + m[2] * b.m[6], m[0] * b.m[1] + m[1] * b.m[4] + m[2] * b.m[7], m[0] * b.m[2] + m[1] * b.m[5] + m[2] * b.m[8],
+			m[3] * b.m[0] + m[4] * b.m[3] + m[5] * b.m[6], m[3] * b.m[1] + m[4] * b.m[4] + m[5] * b.m[7], m[3] * b.m[2] + m[4] * b.m[5] + m[5] * b.m[8],
+			m[6] * b.m[0] + m[7] * b.m[3] + m[8] * b.m[6], m[6] * b.m[1] + m[7] * b.m[4] + m[8] * b.m[7], m[6] * b.m[2] + m[7] * b.m[5] + m[8] * b.m[8]);
+	}
+
+	// This transform followed by next
+	constexpr Matrix3 compose(const Matrix3& next) const { return next * *this; }
+
+	constexpr float determinant() const {
+		return m[0] * (m[4] * m[8] - m[5] * m[7]) - m[1] * (m[3] * m[8] - m[5] * m[6]) + m[2] * (m[3] * m[7] - m[4] * m[6]);
+	}
+
+	// Transpose of the cofactor matrix, the inverse up to scale
+	constexpr Matrix3 adjoint() const {
+		return Matrix3(
+			m[4] * m[8] - m[5] * m[7], m[2] * m[7] - m[1] * m[8], m[1] * m[5] - m[2] * m[4],
+			m[5] * m[6] - m[3] * m[8], m[0] * m[8] - m[2] * m[6], m[2] * m[3] - m[0] * m[5],
+			m[3] * m[7] - m[4] * m[6], m[1] * m[6] - m[0] * m[7], m[0] * m[4] - m[1] * m[3]);
+	}
+
+	// A singular matrix gives its adjoint, which is still the projective inverse where one exists
+	Matrix3 inverse() const;
+
+	constexpr float mapX(float x, float y) const { return (m[0] * x + m[1] * y + m[2]) / (m[6] * x + m[7] * y + m[8]); }
+	constexpr float mapY(float x, float y) const { return (m[3] * x + m[4] * y + m[5]) / (m[6] * x + m[7] * y + m[8]); }
+
+	// Map n points given as separate x / y arrays, 4 at a time with SSE2. Output may alias input.
+	void transformPoints(const float* xs, const float* ys, size_t n, float* outX, float* outY) const;
+};
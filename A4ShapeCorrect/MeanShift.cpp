@@ -1,11 +1,17 @@
 
 #include "MeanShift.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MS_USE_SSE2
+#endif
+
 //---------------- Definition ---------------------------------------
 #define MS_MAX_NUM_CONVERGENCE_STEPS	5											// up to 5 steps are for convergence
 #define MS_MEAN_SHIFT_TOL_COLOR			0.3											// minimum mean color shift change
 #define MS_MEAN_SHIFT_TOL_SPATIAL		0.3											// minimum mean spatial shift change
-const int dxdy[][2] = { {-1,-1},{-1,0},{-1,1},{0,-1},{0,1},{1,-1},{1,0},{1,1} };	// Region Growing
+#define MS_ACCEL_BAND_ROWS				32											// rows sharing one cell map in the accelerated filter
+const int dxdy[][2] = { {-1,0},{-1,-1},{0,-1},{1,-1} };							// Neighbours labeled before a pixel
 
 // Constructor
 Point5D::Point5D() {
@@ -37,7 +43,7 @@ void Point5D::PointRGB() {
 }
 
 // Accumulate points
-void Point5D::MSPoint5DAccum(Point5D Pt) {
+void Point5D::MSPoint5DAccum(const Point5D& Pt) {
 	x += Pt.x;
 	y += Pt.y;
 	l += Pt.l;
@@ -46,12 +52,17 @@ void Point5D::MSPoint5DAccum(Point5D Pt) {
 }
 
 // Compute color space distance between two points
-float Point5D::MSPoint5DColorDistance(Point5D Pt) {
-	return sqrt((l - Pt.l) * (l - Pt.l) + (a - Pt.a) * (a - Pt.a) + (b - Pt.b) * (b - Pt.b));
+float Point5D::MSPoint5DColorDistance(const Point5D& Pt) const {
+	return sqrt(MSPoint5DColorDistance2(Pt));
+}
+
+// Squared color space distance, to compare with hr * hr without a sqrt
+float Point5D::MSPoint5DColorDistance2(const Point5D& Pt) const {
+	return (l - Pt.l) * (l - Pt.l) + (a - Pt.a) * (a - Pt.a) + (b - Pt.b) * (b - Pt.b);
 }
 
 // Compute spatial space distance between two points
-float Point5D::MSPoint5DSpatialDistance(Point5D Pt) {
+float Point5D::MSPoint5DSpatialDistance(const Point5D& Pt) const {
 	return sqrt((x - Pt.x) * (x - Pt.x) + (y - Pt.y) * (y - Pt.y));
 }
 
@@ -69,169 +80,624 @@ void Point5D::Print() {
 	cout << x << " " << y << " " << l << " " << a << " " << b << endl;
 }
 
+// Convert a RGB image, row by row so the arrays are reused when large enough
+void LabImage::assign(const CImg<>& Img) {
+	width = Img.width();
+	height = Img.height();
+	resize(width, height);
+	CImg<> Row(width, 1, 1, 3);
+	cimg_forY(Img, y) {
+		cimg_forXC(Row, x, c)
+			Row(x, 0, 0, c) = Img(x, y, 0, c);
+		Row.RGBtoLab();
+		copy(Row.data(0, 0, 0, 0), Row.data(0, 0, 0, 0) + width, &L[y * width]);
+		copy(Row.data(0, 0, 0, 1), Row.data(0, 0, 0, 1) + width, &A[y * width]);
+		copy(Row.data(0, 0, 0, 2), Row.data(0, 0, 0, 2) + width, &B[y * width]);
+	}
+}
+
+// Set the size, keeping the arrays when they are large enough
+void LabImage::resize(int w, int h) {
+	width = w;
+	height = h;
+	L.resize(w * h);
+	A.resize(w * h);
+	B.resize(w * h);
+}
+
+// Region starting at a pixel, empty
+MSRegion::MSRegion(int x, int y) {
+	Area = 0;
+	Left = Right = x;
+	Top = Bottom = y;
+	L = A = B = 0;
+}
+
+// Add a pixel, its color summed until finish()
+void MSRegion::add(int x, int y, float l, float a, float b) {
+	Area++;
+	Left = min(Left, x);
+	Right = max(Right, x);
+	Top = min(Top, y);
+	Bottom = max(Bottom, y);
+	L += l;
+	A += a;
+	B += b;
+}
+
+// Turn the color sums into the mean
+void MSRegion::finish() {
+	L /= Area;
+	A /= Area;
+	B /= Area;
+}
+
+// Take in another finished region
+void MSRegion::merge(const MSRegion& R) {
+	float w = (float)R.Area / (Area + R.Area);
+	L += (R.L - L) * w;
+	A += (R.A - A) * w;
+	B += (R.B - B) * w;
+	Area += R.Area;
+	Left = min(Left, R.Left);
+	Right = max(Right, R.Right);
+	Top = min(Top, R.Top);
+	Bottom = max(Bottom, R.Bottom);
+}
+
+// Squared distance of the mean colors
+float MSRegion::ColorDistance2(const MSRegion& R) const {
+	return (L - R.L) * (L - R.L) + (A - R.A) * (A - R.A) + (B - R.B) * (B - R.B);
+}
+
+// Size the buffers for a cols x rows image; they only ever grow
+void MSWorkspace::assign(int cols, int rows) {
+	int N = cols * rows;
+	Lab.resize(cols, rows);
+	Filtered.resize(cols, rows);
+	Labels.assign(N, -1);
+	Assigned.assign(N, 0);
+	Regions.clear();
+	Coarse.clear();
+}
+
+// Memory held by the buffers
+size_t MSWorkspace::bytes() const {
+	return (Lab.L.capacity() + Lab.A.capacity() + Lab.B.capacity() +
+		Filtered.L.capacity() + Filtered.A.capacity() + Filtered.B.capacity() +
+		Small.L.capacity() + Small.A.capacity() + Small.B.capacity()) * sizeof(float) +
+		(Labels.capacity() + Parent.capacity() + Nearest.capacity() + Coarse.capacity()) * sizeof(int) + NearestDistance.capacity() * sizeof(float) +
+		Regions.capacity() * sizeof(MSRegion) + Edges.capacity() * sizeof(pair<int, int>) + Assigned.capacity();
+}
+
 // Constructor for spatial bandwidth and color bandwidth
 MeanShift::MeanShift(float s, float r) {
 	hs = s;
 	hr = r;
+	InPlace = false;
+	Threads = 0;
+	Accelerated = false;
+	MinRegion = 0;
+	Scale = 1;
 }
 
-void MeanShift::MSSegmentation(CImg<>& Img) {
+// Sum the points of the window [Left, Right) x [Top, Bottom) whose color lies within hr of Center,
+// returns their number. 8 points are tested at once (SSE2 when available), then 4, then the rest one
+// by one: the squared distance is compared with hr * hr and the points are added under the comparison mask
+int MeanShift::MSWindowSum(const LabImage& Lab, int Left, int Right, int Top, int Bottom, const Point5D& Center, Point5D& Sum) {
+	const float hr2 = hr * hr;
+	float SumX = 0, SumY = 0, SumL = 0, SumA = 0, SumB = 0;
+	int NumPts = 0;
+#ifdef MS_USE_SSE2
+	const __m128 cl = _mm_set1_ps(Center.l), ca = _mm_set1_ps(Center.a), cb = _mm_set1_ps(Center.b);
+	const __m128 r2 = _mm_set1_ps(hr2), one = _mm_set1_ps(1), four = _mm_set1_ps(4);
+	__m128 sx = _mm_setzero_ps(), sl = _mm_setzero_ps(), sa = _mm_setzero_ps(), sb = _mm_setzero_ps(), sn = _mm_setzero_ps();
+#endif
+	for (int hy = Top; hy < Bottom; hy++) {
+		const float* L = &Lab.L[Lab.index(0, hy)];
+		const float* A = &Lab.A[Lab.index(0, hy)];
+		const float* B = &Lab.B[Lab.index(0, hy)];
+		int hx = Left;
+#ifdef MS_USE_SSE2
+		__m128 rn = _mm_setzero_ps();							// Points of this row, for the y sum
+		__m128 col = _mm_setr_ps(hx, hx + 1, hx + 2, hx + 3);
+		auto Accum4 = [&](int x) {
+			const __m128 l = _mm_loadu_ps(L + x), a = _mm_loadu_ps(A + x), b = _mm_loadu_ps(B + x);
+			const __m128 dl = _mm_sub_ps(l, cl), da = _mm_sub_ps(a, ca), db = _mm_sub_ps(b, cb);
+			const __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dl, dl), _mm_mul_ps(da, da)), _mm_mul_ps(db, db));
+			const __m128 in = _mm_cmplt_ps(d2, r2);
+			sx = _mm_add_ps(sx, _mm_and_ps(in, col));
+			sl = _mm_add_ps(sl, _mm_and_ps(in, l));
+			sa = _mm_add_ps(sa, _mm_and_ps(in, a));
+			sb = _mm_add_ps(sb, _mm_and_ps(in, b));
+			rn = _mm_add_ps(rn, _mm_and_ps(in, one));
+			col = _mm_add_ps(col, four);
+		};
+		for (; hx + 8 <= Right; hx += 8) {
+			Accum4(hx);
+			Accum4(hx + 4);
+		}
+		if (hx + 4 <= Right) {
+			Accum4(hx);
+			hx += 4;
+		}
+		sn = _mm_add_ps(sn, rn);
+		float n[4];
+		_mm_storeu_ps(n, rn);
+		SumY += (n[0] + n[1] + n[2] + n[3]) * hy;
+#endif
+		// Remaining points of the row
+		for (; hx < Right; hx++) {
+			const float dl = L[hx] - Center.l, da = A[hx] - Center.a, db = B[hx] - Center.b;
+			if (dl * dl + da * da + db * db < hr2) {
+				SumX += hx;
+				SumY += hy;
+				SumL += L[hx];
+				SumA += A[hx];
+				SumB += B[hx];
+				NumPts++;
+			}
+		}
+	}
+#ifdef MS_USE_SSE2
+	float v[5][4];
+	_mm_storeu_ps(v[0], sx);
+	_mm_storeu_ps(v[1], sl);
+	_mm_storeu_ps(v[2], sa);
+	_mm_storeu_ps(v[3], sb);
+	_mm_storeu_ps(v[4], sn);
+	SumX += v[0][0] + v[0][1] + v[0][2] + v[0][3];
+	SumL += v[1][0] + v[1][1] + v[1][2] + v[1][3];
+	SumA += v[2][0] + v[2][1] + v[2][2] + v[2][3];
+	SumB += v[3][0] + v[3][1] + v[3][2] + v[3][3];
+	NumPts += (int)(v[4][0] + v[4][1] + v[4][2] + v[4][3]);
+#endif
+	Sum = Point5D(SumX, SumY, SumL, SumA, SumB);
+	return NumPts;
+}
 
-	//---------------- Mean Shift Filtering -----------------------------
-	int ROWS = Img.height();		// Get row number
-	int COLS = Img.width();			// Get column number
+// Filter one pixel: shift its 5D point to the mean of its window of radius Hs until it converges
+Point5D MeanShift::MSFilterPoint(const LabImage& Lab, int i, int j, float Hs) {
+	int ROWS = Lab.height;
+	int COLS = Lab.width;
 
 	Point5D PtCur;					// Current point
 	Point5D PtPrev;					// Previous point
 	Point5D PtSum;					// Sum vector of the shift vector
-	Point5D Pt;
-	int Left;						// Left boundary
-	int Right;						// Right boundary
-	int Top;						// Top boundary
-	int Bottom;						// Bottom boundary
 	int NumPts;						// number of points in a hypersphere
 	int step;
 
-	cimg_forXY(Img, i, j) {
-		Left = (i - hs) > 0 ? (i - hs) : 0;						// Get Left boundary of the filter
-		Right = (i + hs) < COLS ? (i + hs) : COLS;				// Get Right boundary of the filter
-		Top = (j - hs) > 0 ? (j - hs) : 0;						// Get Top boundary of the filter
-		Bottom = (j + hs) < ROWS ? (j + hs) : ROWS;				// Get Bottom boundary of the filter
-		// Set current point and scale it to Lab color range
-		PtCur = Point5D(i, j, (float)Img(i, j, 0), (float)Img(i, j, 1), (float)Img(i, j, 2));
-		PtCur.PointLab();
-		step = 0;												// count the times
-		do {
-			PtPrev = PtCur;										// Set the original point and previous one
-			PtSum = Point5D(0, 0, 0, 0, 0);						// Initial Sum vector
-			NumPts = 0;											// Count number of points that satisfy the bandwidths
-			for (int hx = Left; hx < Right; hx++) {
-				for (int hy = Top; hy < Bottom; hy++) {
-					// Set point in the spatial bandwidth
-					Pt = Point5D(hx, hy, (float)Img(hx, hy, 0), (float)Img(hx, hy, 1), (float)Img(hx, hy, 2));
-					Pt.PointLab();
-
-					// Check it satisfied color bandwidth or not
-					if (Pt.MSPoint5DColorDistance(PtCur) < hr) {
-						PtSum.MSPoint5DAccum(Pt);				// Accumulate the point to Sum vector
-						NumPts++;								// Count
+	int Left = (i - Hs) > 0 ? (i - Hs) : 0;						// Get Left boundary of the filter
+	int Right = (i + Hs) < COLS ? (i + Hs) : COLS;				// Get Right boundary of the filter
+	int Top = (j - Hs) > 0 ? (j - Hs) : 0;						// Get Top boundary of the filter
+	int Bottom = (j + Hs) < ROWS ? (j + Hs) : ROWS;				// Get Bottom boundary of the filter
+	// Set current point
+	int idx = Lab.index(i, j);
+	PtCur = Point5D(i, j, Lab.L[idx], Lab.A[idx], Lab.B[idx]);
+	step = 0;													// count the times
+	do {
+		PtPrev = PtCur;											// Set the original point and previous one
+		// Sum and count the points that satisfy the bandwidths
+		NumPts = MSWindowSum(Lab, Left, Right, Top, Bottom, PtCur, PtSum);
+		PtSum.MSPoint5DScale(1.0 / NumPts);						// Scale Sum vector to average vector
+		PtCur = PtSum;											// Get new origin point
+		step++;													// One time end
+	// filter iteration to end
+	} while ((PtCur.MSPoint5DColorDistance2(PtPrev) > MS_MEAN_SHIFT_TOL_COLOR * MS_MEAN_SHIFT_TOL_COLOR) &&
+		(PtCur.MSPoint5DSpatialDistance(PtPrev) > MS_MEAN_SHIFT_TOL_SPATIAL) && (step < MS_MAX_NUM_CONVERGENCE_STEPS));
+
+	return PtCur;
+}
+
+// Cell of a 5D point: Hs / 2 wide in space, hr / 4 wide in color, 16 bits per spatial and 10 per color index
+unsigned long long MeanShift::MSCellKey(const Point5D& Pt, float Hs) const {
+	const float cs = max(1.0f, Hs / 2), cr = max(0.5f, hr / 4);
+	auto Cell = [](float v, float size, int bits) {
+		int c = (int)floor(v / size) + (1 << (bits - 1));
+		return (unsigned long long)min(max(c, 0), (1 << bits) - 1);
+	};
+	return Cell(Pt.x, cs, 16) | Cell(Pt.y, cs, 16) << 16 | Cell(Pt.l, cr, 10) << 32 | Cell(Pt.a, cr, 10) << 42 | Cell(Pt.b, cr, 10) << 52;
+}
+
+// Accelerated filtering of rows [y0, y1): a trajectory stops as soon as it enters a cell where an earlier
+// trajectory passed, and takes that trajectory's mode; the cells it visited then get its mode, and the pixels
+// around it whose color is within hr / 2 of it are assigned the mode without a trajectory of their own.
+// Cells are only shared inside the rows, so the result does not depend on the number of threads
+void MeanShift::MSFilterBand(const LabImage& Lab, LabImage& Filtered, vector<uchar>& Assigned, int y0, int y1, float Hs, MSModeCells& Cells, vector<Point5D>& Path) {
+	int ROWS = Lab.height;
+	int COLS = Lab.width;
+	const float near2 = hr * hr / 4;
+
+	Point5D PtCur;					// Current point
+	Point5D PtPrev;					// Previous point
+	Point5D PtSum;					// Sum vector of the shift vector
+	int NumPts;						// number of points in a hypersphere
+
+	Cells.clear();
+	for (int j = y0; j < y1; j++) {
+		for (int i = 0; i < COLS; i++) {
+			int idx = Lab.index(i, j);
+			if (Assigned[idx])
+				continue;
+
+			int Left = (i - Hs) > 0 ? (i - Hs) : 0;
+			int Right = (i + Hs) < COLS ? (i + Hs) : COLS;
+			int Top = (j - Hs) > 0 ? (j - Hs) : 0;
+			int Bottom = (j + Hs) < ROWS ? (j + Hs) : ROWS;
+			PtCur = Point5D(i, j, Lab.L[idx], Lab.A[idx], Lab.B[idx]);
+			Path.clear();
+			bool Inherited = false;
+			for (int step = 0; ; ) {
+				auto Cell = Cells.find(MSCellKey(PtCur, Hs));
+				if (Cell != Cells.end()) {
+					PtCur = Cell->second;						// Join the earlier trajectory
+					Inherited = true;
+					break;
+				}
+				Path.push_back(PtCur);
+				PtPrev = PtCur;
+				NumPts = MSWindowSum(Lab, Left, Right, Top, Bottom, PtCur, PtSum);
+				PtSum.MSPoint5DScale(1.0 / NumPts);
+				PtCur = PtSum;
+				step++;
+				if ((PtCur.MSPoint5DColorDistance2(PtPrev) <= MS_MEAN_SHIFT_TOL_COLOR * MS_MEAN_SHIFT_TOL_COLOR) ||
+					(PtCur.MSPoint5DSpatialDistance(PtPrev) <= MS_MEAN_SHIFT_TOL_SPATIAL) || (step == MS_MAX_NUM_CONVERGENCE_STEPS))
+					break;
+			}
+			if (!Inherited)
+				Cells[MSCellKey(PtCur, Hs)] = PtCur;
+
+			// Every cell of the trajectory leads to its mode, and so do the pixels close to it
+			for (const Point5D& P : Path) {
+				Cells[MSCellKey(P, Hs)] = PtCur;
+				int px = (int)(P.x + 0.5f), py = (int)(P.y + 0.5f);
+				for (int y = max(py - 1, y0); y <= min(py + 1, y1 - 1); y++) {
+					for (int x = max(px - 1, 0); x <= min(px + 1, COLS - 1); x++) {
+						int k = Lab.index(x, y);
+						if (!Assigned[k] && P.MSPoint5DColorDistance2(Point5D(x, y, Lab.L[k], Lab.A[k], Lab.B[k])) < near2) {
+							Filtered.L[k] = PtCur.l;
+							Filtered.A[k] = PtCur.a;
+							Filtered.B[k] = PtCur.b;
+							Assigned[k] = 1;
+						}
 					}
 				}
 			}
-			PtSum.MSPoint5DScale(1.0 / NumPts);					// Scale Sum vector to average vector
-			PtCur = PtSum;										// Get new origin point
-			step++;												// One time end
-		// filter iteration to end
-		} while ((PtCur.MSPoint5DColorDistance(PtPrev) > MS_MEAN_SHIFT_TOL_COLOR) &&
-			(PtCur.MSPoint5DSpatialDistance(PtPrev) > MS_MEAN_SHIFT_TOL_SPATIAL) && (step < MS_MAX_NUM_CONVERGENCE_STEPS));
+			Filtered.L[idx] = PtCur.l;
+			Filtered.A[idx] = PtCur.a;
+			Filtered.B[idx] = PtCur.b;
+			Assigned[idx] = 1;
+		}
+	}
+}
+
+const vector<MSRegion>& MeanShift::MSSegmentation(CImg<>& Img) {
+	return MSSegmentation(Img, Workspace);
+}
+
+const vector<MSRegion>& MeanShift::MSSegmentation(CImg<>& Img, MSWorkspace& W) {
+	int ROWS = Img.height();		// Get row number
+	int COLS = Img.width();			// Get column number
+
+	W.assign(COLS, ROWS);
+	LabImage& Lab = W.Lab;			// Lab color of the image
+	Lab.assign(Img);
+
+	int s = min(max(Scale, 1), 4);
+	if (s > 1)
+		MSSegmentCoarse(W, s);
+	else {
+		MSFilter(Lab, W.Filtered, W.Assigned, hs);
+		MSLabelRegions(Lab, W);
+		if (MinRegion > 1)
+			MSMergeSmallRegions(Lab, W, MinRegion);
+	}
+
+	// Get result image from the region colors
+	cimg_forXY(Img, i, j) {
+		const MSRegion& R = W.Regions[W.Labels[Lab.index(i, j)]];
+		Img(i, j, 0) = R.L;
+		Img(i, j, 1) = R.A;
+		Img(i, j, 2) = R.B;
+	}
+	Img.LabtoRGB();													// Back to RGB
+	return W.Regions;
+}
+
+// Mean Shift Filtering of a Lab image with spatial radius Hs, the result left in Lab. Filtered and Assigned are scratch buffers
+void MeanShift::MSFilter(LabImage& Lab, LabImage& Filtered, vector<uchar>& Assigned, float Hs) {
+	int ROWS = Lab.height;
+	int COLS = Lab.width;
+
+	Point5D PtCur;					// Current point
+
+	if (InPlace) {
+		// Each pixel reads the pixels filtered before it
+		for (int j = 0; j < ROWS; j++) {
+			for (int i = 0; i < COLS; i++) {
+				PtCur = MSFilterPoint(Lab, i, j, Hs);
+				int idx = Lab.index(i, j);
+				Lab.L[idx] = PtCur.l;
+				Lab.A[idx] = PtCur.a;
+				Lab.B[idx] = PtCur.b;
+			}
+		}
+	}
+	else {
+		// Read the unfiltered image, write a second buffer; rows are handed out one at a time
+		// since the number of steps differs from pixel to pixel
+		Filtered.resize(COLS, ROWS);
+		atomic<int> NextRow(0);
+		auto Worker = [&]() {
+			if (Accelerated) {
+				// Bands of rows instead, each with its own cells
+				MSModeCells Cells;
+				vector<Point5D> Path;
+				for (int y0 = (NextRow++) * MS_ACCEL_BAND_ROWS; y0 < ROWS; y0 = (NextRow++) * MS_ACCEL_BAND_ROWS)
+					MSFilterBand(Lab, Filtered, Assigned, y0, min(y0 + MS_ACCEL_BAND_ROWS, ROWS), Hs, Cells, Path);
+				return;
+			}
+			for (int j = NextRow++; j < ROWS; j = NextRow++) {
+				for (int i = 0; i < COLS; i++) {
+					Point5D P = MSFilterPoint(Lab, i, j, Hs);
+					int idx = Lab.index(i, j);
+					Filtered.L[idx] = P.l;
+					Filtered.A[idx] = P.a;
+					Filtered.B[idx] = P.b;
+				}
+			}
+		};
+		int NumThreads = Threads > 0 ? Threads : max(1u, thread::hardware_concurrency());
+		vector<thread> Pool;
+		for (int t = 1; t < NumThreads; t++)
+			Pool.push_back(thread(Worker));
+		Worker();
+		for (auto& T : Pool)
+			T.join();
+		swap(Lab, Filtered);
+	}
+}
 
-		// Scale the color
-		PtCur.PointRGB();
-		// Copy the result to image
-		Img(i, j, 0) = PtCur.l;
-		Img(i, j, 1) = PtCur.a;
-		Img(i, j, 2) = PtCur.b;
+// Filter and label a copy of W.Lab shrunk s times, with hs and MinRegion scaled to match, then
+// bring the labels back to full size. Each pixel takes, among the regions of the 4 coarse pixels
+// around it, the one whose color is nearest to its own, so the boundaries follow the full size edges
+void MeanShift::MSSegmentCoarse(MSWorkspace& W, int s) {
+	int ROWS = W.Lab.height;
+	int COLS = W.Lab.width;
+	const LabImage& Lab = W.Lab;
+	LabImage& Small = W.Small;
+	int sw = (COLS + s - 1) / s, sh = (ROWS + s - 1) / s;
+
+	// Box average of each s x s block, cut at the right and bottom borders
+	Small.resize(sw, sh);
+	for (int y = 0; y < sh; y++) {
+		for (int x = 0; x < sw; x++) {
+			float l = 0, a = 0, b = 0;
+			int n = 0;
+			for (int j = y * s; j < min(y * s + s, ROWS); j++) {
+				for (int i = x * s; i < min(x * s + s, COLS); i++) {
+					int k = Lab.index(i, j);
+					l += Lab.L[k];
+					a += Lab.A[k];
+					b += Lab.B[k];
+					n++;
+				}
+			}
+			int k = Small.index(x, y);
+			Small.L[k] = l / n;
+			Small.A[k] = a / n;
+			Small.B[k] = b / n;
+		}
 	}
-	//--------------------------------------------------------------------
 
-	//----------------------- Segmentation ------------------------------
-	int RegionNumber = 0;			// Reigon number
-	int label = -1;					// Label number
-	float *Mode = new float[ROWS * COLS * 3];					// Store the Lab color of each region
-	int *MemberModeCount = new int[ROWS * COLS];				// Store the number of each region
-	memset(MemberModeCount, 0, ROWS * COLS * sizeof(int));		// Initialize the MemberModeCount
+	int SmallMinRegion = (MinRegion + s * s - 1) / (s * s);
+	MSFilter(Small, W.Filtered, W.Assigned, max(1.0f, hs / s));
+	MSLabelRegions(Small, W);
+	if (SmallMinRegion > 1)
+		MSMergeSmallRegions(Small, W, SmallMinRegion);
 
-	// Label for each point
-	int **Labels = new int *[ROWS];
-	for (int i = 0; i < ROWS; i++)
-		Labels[i] = new int[COLS];
+	// Full size labels
+	vector<int>& Coarse = W.Coarse;
+	Coarse.assign(W.Labels.begin(), W.Labels.begin() + sw * sh);
+	int *Labels = W.Labels.data();
+	vector<MSRegion>& Regions = W.Regions;
+	for (int j = 0; j < ROWS; j++) {
+		int y0 = min(max((int)floor((j + 0.5f) / s - 0.5f), 0), sh - 1), y1 = min(y0 + 1, sh - 1);
+		for (int i = 0; i < COLS; i++) {
+			int x0 = min(max((int)floor((i + 0.5f) / s - 0.5f), 0), sw - 1), x1 = min(x0 + 1, sw - 1);
+			const int Around[4] = { Coarse[Small.index(x0, y0)], Coarse[Small.index(x1, y0)],
+				Coarse[Small.index(x0, y1)], Coarse[Small.index(x1, y1)] };
+			int k = Lab.index(i, j);
+			int label = Around[0];
+			if (Around[1] != label || Around[2] != label || Around[3] != label) {
+				// On a boundary: nearest region color
+				MSRegion Pixel(i, j);
+				Pixel.L = Lab.L[k];
+				Pixel.A = Lab.A[k];
+				Pixel.B = Lab.B[k];
+				float Best = Pixel.ColorDistance2(Regions[label]);
+				for (int c = 1; c < 4; c++) {
+					float d = Pixel.ColorDistance2(Regions[Around[c]]);
+					if (d < Best) {
+						Best = d;
+						label = Around[c];
+					}
+				}
+			}
+			Labels[k] = label;
+		}
+	}
 
-	// Initialization
-	for (int i = 0; i < ROWS; i++) {
-		for (int j = 0; j < COLS; j++) {
-			Labels[i][j] = -1;
+	// Area and bounding box at full size; regions left without pixels are dropped
+	for (MSRegion& R : Regions) {
+		R.Area = 0;
+		R.Left = COLS;
+		R.Top = ROWS;
+		R.Right = R.Bottom = -1;
+	}
+	for (int j = 0; j < ROWS; j++) {
+		for (int i = 0; i < COLS; i++) {
+			MSRegion& R = Regions[Labels[Lab.index(i, j)]];
+			R.Area++;
+			R.Left = min(R.Left, i);
+			R.Right = max(R.Right, i);
+			R.Top = min(R.Top, j);
+			R.Bottom = max(R.Bottom, j);
+		}
+	}
+	int n = Regions.size(), Count = 0;
+	vector<int>& Number = W.Nearest;
+	Number.resize(n);
+	for (int r = 0; r < n; r++) {
+		if (Regions[r].Area > 0) {
+			Number[r] = Count;
+			Regions[Count++] = Regions[r];
 		}
 	}
+	Regions.resize(Count, MSRegion(0, 0));
+	for (int k = 0; k < ROWS * COLS; k++)
+		Labels[k] = Number[Labels[k]];
+}
 
-	cimg_forXY(Img, i, j) {
-		// If the point is not being labeled
-		if (Labels[i][j] < 0) {
-			Labels[i][j] = ++label;		// Give it a new label number
-			// Get the point
-			PtCur = Point5D(i, j, (float)Img(i, j, 0), (float)Img(i, j, 1), (float)Img(i, j, 2));
-			PtCur.PointLab();
-
-			// Store each value of Lab
-			Mode[label * 3 + 0] = PtCur.l;
-			Mode[label * 3 + 1] = PtCur.a;
-			Mode[label * 3 + 2] = PtCur.b;
-
-			// Region Growing 8 Neighbours
-			vector<Point5D> NeighbourPoints;
-			NeighbourPoints.push_back(PtCur);
-			while (!NeighbourPoints.empty()) {
-				Pt = NeighbourPoints.back();
-				NeighbourPoints.pop_back();
-
-				// Get 8 neighbours
-				for (int k = 0; k < 8; k++) {
-					int hx = Pt.x + dxdy[k][0];
-					int hy = Pt.y + dxdy[k][1];
-					if ((hx > 0) && (hy > 0) && (hx < ROWS) && (hy < COLS) && (Labels[hx][hy] < 0)) {
-						Point5D P(hx, hy, (float)Img(hx, hy, 0), (float)Img(hx, hy, 1), (float)Img(hx, hy, 2));
-						P.PointLab();
-
-						// Check the color
-						if (PtCur.MSPoint5DColorDistance(P) < hr) {
-							// Satisfied the color bandwidth
-							Labels[hx][hy] = label;				// Give the same label					
-							NeighbourPoints.push_back(P);		// Push it into stack
-							MemberModeCount[label]++;			// This region number plus one
-							// Sum all color in same region
-							Mode[label * 3 + 0] += P.l;
-							Mode[label * 3 + 1] += P.a;
-							Mode[label * 3 + 2] += P.b;
-						}
+// Connected regions of the filtered image, neighbours joined when their colors are within hr / 2,
+// as pixels of one mode end up nearly equal while chains of hr steps would cross smooth gradients.
+// First pass: union-find over the 4 neighbours labeled before each pixel, every root being the smallest
+// pixel index of its tree. Second pass: in raster order each parent is met before its children, so a pixel
+// takes the region number already written over its parent; the stats are gathered on the way
+void MeanShift::MSLabelRegions(const LabImage& Lab, MSWorkspace& W) {
+	int ROWS = Lab.height;
+	int COLS = Lab.width;
+	const float near2 = hr * hr / 4;
+	int *Labels = W.Labels.data();
+
+	auto Find = [&](int k) {
+		while (Labels[k] != k) {
+			Labels[k] = Labels[Labels[k]];		// Path halving
+			k = Labels[k];
+		}
+		return k;
+	};
+	for (int j = 0; j < ROWS; j++) {
+		for (int i = 0; i < COLS; i++) {
+			int idx = Lab.index(i, j);
+			Labels[idx] = idx;
+			Point5D P(i, j, Lab.L[idx], Lab.A[idx], Lab.B[idx]);
+			for (int k = 0; k < 4; k++) {
+				int hx = i + dxdy[k][0];
+				int hy = j + dxdy[k][1];
+				if ((hx >= 0) && (hy >= 0) && (hx < COLS)) {
+					int q = Lab.index(hx, hy);
+					if (P.MSPoint5DColorDistance2(Point5D(hx, hy, Lab.L[q], Lab.A[q], Lab.B[q])) < near2) {
+						int rp = Find(idx), rq = Find(q);
+						if (rp != rq)
+							Labels[max(rp, rq)] = min(rp, rq);
 					}
 				}
 			}
-			MemberModeCount[label]++;							// Count the point itself
-			Mode[label * 3 + 0] /= MemberModeCount[label];		// Get average color
-			Mode[label * 3 + 1] /= MemberModeCount[label];
-			Mode[label * 3 + 2] /= MemberModeCount[label];
-		}
-	}
-	RegionNumber = label + 1;										// Get region number
-
-	// Get result image from Mode array
-	for (int i = 0; i < ROWS; i++) {
-		for (int j = 0; j < COLS; j++) {
-			label = Labels[i][j];
-			float l = Mode[label * 3 + 0];
-			float a = Mode[label * 3 + 1];
-			float b = Mode[label * 3 + 2];
-			Point5D Pixel(i, j, l, a, b);
-			Pixel.PointRGB();
-			// Pixel.Print();
-			Img(i, j, 0) = Pixel.l;
-			Img(i, j, 1) = Pixel.a;
-			Img(i, j, 2) = Pixel.b;
-		}
-	}
-	//--------------------------------------------------------------------
-
-	//	for(int i = 0; i < ROWS; i++){
-	//		for(int j = 0; j < COLS - 1; j++){
-	//			if(Labels[i][j] != Labels[i][j + 1])
-	//				Img.at<Vec3b>(i, j) = Vec3b(255, 255, 255);
-	//		}
-	//	}
-
-	//--------------- Delete Memory Applied Before -----------------------
-	/*delete[] Mode;
-	delete[] MemberModeCount;
-
-	for (int i = 0; i < ROWS; i++)
-		delete[] Labels[i];
-	delete[] Labels;*/
+		}
+	}
+
+	W.Regions.clear();
+	for (int j = 0; j < ROWS; j++) {
+		for (int i = 0; i < COLS; i++) {
+			int idx = Lab.index(i, j);
+			if (Labels[idx] == idx) {
+				Labels[idx] = W.Regions.size();
+				W.Regions.push_back(MSRegion(i, j));
+			}
+			else
+				Labels[idx] = Labels[Labels[idx]];
+			W.Regions[Labels[idx]].add(i, j, Lab.L[idx], Lab.A[idx], Lab.B[idx]);
+		}
+	}
+	for (MSRegion& R : W.Regions)
+		R.finish();
+}
+
+// Merge every region smaller than MinSize pixels into the adjacent region of the nearest color. The pairs of
+// adjacent regions are collected once; then, round after round, each small region picks its nearest
+// neighbour and the pairs are joined with union-find, until no small region has a neighbour left
+void MeanShift::MSMergeSmallRegions(const LabImage& Lab, MSWorkspace& W, int MinSize) {
+	int ROWS = Lab.height;
+	int COLS = Lab.width;
+	int n = W.Regions.size();
+	int *Labels = W.Labels.data();
+	vector<MSRegion>& Regions = W.Regions;
+	vector<int>& Parent = W.Parent;
+	vector<int>& Nearest = W.Nearest;
+	vector<float>& NearestDistance = W.NearestDistance;
+	vector<pair<int, int> >& Edges = W.Edges;
+
+	// Adjacent regions, each pair once
+	Edges.clear();
+	for (int j = 0; j < ROWS; j++) {
+		for (int i = 0; i < COLS; i++) {
+			int r = Labels[Lab.index(i, j)];
+			if (i + 1 < COLS && Labels[Lab.index(i + 1, j)] != r)
+				Edges.push_back(make_pair(min(r, Labels[Lab.index(i + 1, j)]), max(r, Labels[Lab.index(i + 1, j)])));
+			if (j + 1 < ROWS && Labels[Lab.index(i, j + 1)] != r)
+				Edges.push_back(make_pair(min(r, Labels[Lab.index(i, j + 1)]), max(r, Labels[Lab.index(i, j + 1)])));
+		}
+	}
+	sort(Edges.begin(), Edges.end());
+	Edges.erase(unique(Edges.begin(), Edges.end()), Edges.end());
+
+	Parent.resize(n);
+	for (int r = 0; r < n; r++)
+		Parent[r] = r;
+	auto Find = [&](int k) {
+		while (Parent[k] != k) {
+			Parent[k] = Parent[Parent[k]];
+			k = Parent[k];
+		}
+		return k;
+	};
+
+	bool Merged = true;
+	while (Merged) {
+		// Nearest colored neighbour of each small region, from the stats at the start of the round
+		Nearest.assign(n, -1);
+		NearestDistance.resize(n);
+		size_t Live = 0;
+		for (size_t e = 0; e < Edges.size(); e++) {
+			int r = Find(Edges[e].first), s = Find(Edges[e].second);
+			if (r == s)
+				continue;
+			Edges[Live++] = make_pair(r, s);			// Drop the pairs inside one region
+			float d = Regions[r].ColorDistance2(Regions[s]);
+			if (Regions[r].Area < MinSize && (Nearest[r] < 0 || d < NearestDistance[r])) {
+				Nearest[r] = s;
+				NearestDistance[r] = d;
+			}
+			if (Regions[s].Area < MinSize && (Nearest[s] < 0 || d < NearestDistance[s])) {
+				Nearest[s] = r;
+				NearestDistance[s] = d;
+			}
+		}
+		Edges.resize(Live);
+
+		Merged = false;
+		for (int r = 0; r < n; r++) {
+			if (Nearest[r] < 0)
+				continue;
+			int a = Find(r), b = Find(Nearest[r]);
+			if (a == b)
+				continue;
+			Regions[a].merge(Regions[b]);
+			Parent[b] = a;
+			Merged = true;
+		}
+	}
+
+	// Number the remaining regions in order and relabel the pixels
+	int Count = 0;
+	for (int r = 0; r < n; r++) {
+		if (Find(r) == r) {
+			Nearest[r] = Count;
+			Regions[Count++] = Regions[r];
+		}
+	}
+	for (int k = 0; k < ROWS * COLS; k++)
+		Labels[k] = Nearest[Find(Labels[k])];
+	Regions.resize(Count, MSRegion(0, 0));
 }
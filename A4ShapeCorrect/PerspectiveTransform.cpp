@@ -1,4 +1,5 @@
 #include "PerspectiveTransform.h"
+#include "PerspectiveWarp.h"
 
 PerspectiveTransform::PerspectiveTransform(float inA11, float inA21,
 	float inA31, float inA12,
@@ -8,6 +9,17 @@ PerspectiveTransform::PerspectiveTransform(float inA11, float inA21,
 	a11(inA11), a12(inA12), a13(inA13), a21(inA21), a22(inA22), a23(inA23),
 	a31(inA31), a32(inA32), a33(inA33) {}
 PerspectiveTransform::PerspectiveTransform() {}
+PerspectiveTransform::PerspectiveTransform(const Matrix3& h) :
+	a11(h.m[0]), a12(h.m[3]), a13(h.m[6]), a21(h.m[1]), a22(h.m[4]), a23(h.m[7]),
+	a31(h.m[2]), a32(h.m[5]), a33(h.m[8]) {}
+
+Matrix3 PerspectiveTransform::matrix() const {
+	return Matrix3(a11, a21, a31, a12, a22, a32, a13, a23, a33);
+}
+
+void PerspectiveTransform::transformPoints(const float* xs, const float* ys, size_t n, float* outX, float* outY) const {
+	matrix().transformPoints(xs, ys, n, outX, outY);
+}
 
 
 PerspectiveTransform PerspectiveTransform::quadrilateralToQuadrilateral(float x0, float y0, float x1, float y1,
@@ -63,4 +75,24 @@ PerspectiveTransform PerspectiveTransform::times(PerspectiveTransform other) {
 		* other.a11 + a23 * other.a12 + a33 * other.a13, a13 * other.a21 + a23 * other.a22 + a33
 		* other.a23, a13 * other.a31 + a23 * other.a32 + a33 * other.a33));
 	return result;
-}
\ No newline at end of file
+}
+
+PerspectiveTransform PerspectiveTransform::pageTransform(const vector<pair<int, int>>& vertex, int width, int height)
+{
+	return quadrilateralToQuadrilateral(0, 0, width - 1, 0, 0, height - 1, width - 1, height - 1,
+		vertex[0].first, vertex[0].second, vertex[1].first, vertex[1].second,
+		vertex[2].first, vertex[2].second, vertex[3].first, vertex[3].second);
+}
+
+CImg<uchar> PerspectiveTransform::getTransform(const CImg<uchar>& src, const vector<pair<int, int>>& vertex, int width, int height,
+	int threads, bool antialias)
+{
+	PerspectiveTransform H = pageTransform(vertex, width, height);
+
+	CImg<uchar> dest(width, height, 1, src.spectrum());
+	if (antialias)
+		warpPerspectiveMip(src, H, dest, threads);
+	else
+		warpPerspective(src, H, dest, threads);
+	return dest;
+}
@@ -1,4 +1,6 @@
 #pragma once
+#include "Hough.h"
+#include "Matrix3.h"
 
 class PerspectiveTransform {
 public:
@@ -7,6 +9,10 @@ public:
 public:
 	PerspectiveTransform(float, float, float, float, float, float, float, float, float);
 	PerspectiveTransform();
+	PerspectiveTransform(const Matrix3&);
+
+	Matrix3 matrix() const;		//Same mapping as a row-major 3x3 value
+	void transformPoints(const float* xs, const float* ys, size_t n, float* outX, float* outY) const;
 
 	PerspectiveTransform quadrilateralToQuadrilateral(float, float, float, float, float,
 		float, float, float, float, float, float, float, float, float, float, float);
@@ -18,4 +24,11 @@ public:
 	PerspectiveTransform buildAdjoint();
 
 	PerspectiveTransform times(PerspectiveTransform);
+
+	// Map from a width x height page to the quad vertex (top-left, top-right, bottom-left, bottom-right)
+	PerspectiveTransform pageTransform(const vector<pair<int, int>>& vertex, int width, int height);
+
+	// Warp the page with corners vertex straight to width x height, antialiased when shrinking
+	CImg<uchar> getTransform(const CImg<uchar>& src, const vector<pair<int, int>>& vertex, int width, int height,
+		int threads = 0, bool antialias = false);
 };
\ No newline at end of file
@@ -0,0 +1,216 @@
+#include "PerspectiveWarp.h"
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define WARP_USE_SSE2
+#endif
+
+// Source position of one pixel, NaN and out of range values clamped to the border
+static inline float clampCoord(float v, float hi)
+{
+	return v >= 0 ? (v < hi ? v : hi) : 0;
+}
+
+void mapPerspectiveRow(const PerspectiveTransform& H, int y, int width, int srcW, int srcH,
+	int* offset, int* stepX, int* stepY, float* wx, float* wy)
+{
+	const float maxX = srcW - 1, maxY = srcH - 1;
+	const float nx0 = H.a21 * y + H.a31, ny0 = H.a22 * y + H.a32, d0 = H.a23 * y + H.a33;
+	int x = 0;
+#ifdef WARP_USE_SSE2
+	// Positions are rebuilt from the column index, summing the steps would drift on wide pages
+	const __m128 ax = _mm_set1_ps(H.a11), ay = _mm_set1_ps(H.a12), ad = _mm_set1_ps(H.a13);
+	const __m128 bx = _mm_set1_ps(nx0), by = _mm_set1_ps(ny0), bd = _mm_set1_ps(d0);
+	const __m128 four = _mm_set1_ps(4);
+	__m128 col = _mm_setr_ps(0, 1, 2, 3);
+	const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1);
+	const __m128 hiX = _mm_set1_ps(maxX), hiY = _mm_set1_ps(maxY);
+	const __m128i w = _mm_set1_epi32(srcW), lastX = _mm_set1_epi32(srcW - 1), lastY = _mm_set1_epi32(srcH - 1);
+	const __m128i oneI = _mm_set1_epi32(1);
+	// iy * srcW is taken from 16-bit halves, larger sources are left to the scalar loop
+	const int vectorWidth = srcW < 32768 && srcH < 32768 ? width : 0;
+	for (; x + 8 <= vectorWidth; x += 8) {
+		for (int h = 0; h < 8; h += 4) {
+			const __m128 nx = _mm_add_ps(bx, _mm_mul_ps(ax, col));
+			const __m128 ny = _mm_add_ps(by, _mm_mul_ps(ay, col));
+			const __m128 inv = _mm_div_ps(one, _mm_add_ps(bd, _mm_mul_ps(ad, col)));
+			// max() first so that NaN becomes 0
+			__m128 tx = _mm_min_ps(_mm_max_ps(_mm_mul_ps(nx, inv), zero), hiX);
+			__m128 ty = _mm_min_ps(_mm_max_ps(_mm_mul_ps(ny, inv), zero), hiY);
+			__m128i ix = _mm_cvttps_epi32(tx), iy = _mm_cvttps_epi32(ty);
+			_mm_storeu_ps(wx + x + h, _mm_sub_ps(tx, _mm_cvtepi32_ps(ix)));
+			_mm_storeu_ps(wy + x + h, _mm_sub_ps(ty, _mm_cvtepi32_ps(iy)));
+			__m128i off = _mm_add_epi32(_mm_madd_epi16(iy, w), ix);
+			_mm_storeu_si128((__m128i*)(offset + x + h), off);
+			_mm_storeu_si128((__m128i*)(stepX + x + h), _mm_and_si128(_mm_cmplt_epi32(ix, lastX), oneI));
+			_mm_storeu_si128((__m128i*)(stepY + x + h), _mm_and_si128(_mm_cmplt_epi32(iy, lastY), w));
+			col = _mm_add_ps(col, four);
+		}
+	}
+#endif
+	for (; x < width; ++x) {
+		const float d = d0 + H.a13 * x;
+		const float tx = clampCoord((nx0 + H.a11 * x) / d, maxX);
+		const float ty = clampCoord((ny0 + H.a12 * x) / d, maxY);
+		const int ix = (int)tx, iy = (int)ty;
+		offset[x] = iy * srcW + ix;
+		stepX[x] = ix < srcW - 1 ? 1 : 0;
+		stepY[x] = iy < srcH - 1 ? srcW : 0;
+		wx[x] = tx - ix;
+		wy[x] = ty - iy;
+	}
+}
+
+static void warpRows(const CImg<uchar>& src, const PerspectiveTransform& H, CImg<uchar>& dest, int y0, int y1)
+{
+	const int width = dest.width();
+	vector<int> offset(width), stepX(width), stepY(width);
+	vector<float> wx(width), wy(width);
+	for (int y = y0; y < y1; ++y) {
+		mapPerspectiveRow(H, y, width, src.width(), src.height(), offset.data(), stepX.data(), stepY.data(), wx.data(), wy.data());
+		cimg_forC(dest, c) {
+			const uchar* plane = src.data(0, 0, 0, c);
+			uchar* out = dest.data(0, y, 0, c);
+			for (int x = 0; x < width; ++x) {
+				const uchar* p = plane + offset[x];
+				const float top = p[0] + wx[x] * (p[stepX[x]] - p[0]);
+				const float bottom = p[stepY[x]] + wx[x] * (p[stepY[x] + stepX[x]] - p[stepY[x]]);
+				out[x] = (uchar)(top + wy[x] * (bottom - top));
+			}
+		}
+	}
+}
+
+void parallelRows(int height, int threads, const function<void(int, int)>& rows)
+{
+	if (threads <= 0)
+		threads = max(1u, thread::hardware_concurrency());
+	threads = max(1, min(threads, height));
+
+	vector<thread> pool;
+	const int step = (height + threads - 1) / threads;
+	for (int i = 1; i < threads; ++i) {
+		const int y0 = i * step, y1 = min(height, y0 + step);
+		if (y0 < y1)
+			pool.push_back(thread(rows, y0, y1));
+	}
+	rows(0, min(step, height));
+	for (auto& th : pool)
+		th.join();
+}
+
+void warpPerspective(const CImg<uchar>& src, const PerspectiveTransform& H, CImg<uchar>& dest, int threads)
+{
+	if (dest.spectrum() != src.spectrum())
+		dest.assign(dest.width(), dest.height(), 1, src.spectrum());
+	parallelRows(dest.height(), threads, [&](int y0, int y1) {
+		warpRows(src, H, dest, y0, y1);
+	});
+}
+
+float warpFootprint(const PerspectiveTransform& H, float x, float y)
+{
+	const float d = H.a13 * x + H.a23 * y + H.a33;
+	const float u = (H.a11 * x + H.a21 * y + H.a31) / d;
+	const float v = (H.a12 * x + H.a22 * y + H.a32) / d;
+	// Columns of the Jacobian: source step of one destination pixel along x and along y
+	const float ux = (H.a11 - u * H.a13) / d, vx = (H.a12 - v * H.a13) / d;
+	const float uy = (H.a21 - u * H.a23) / d, vy = (H.a22 - v * H.a23) / d;
+	return sqrt(max(ux * ux + vx * vx, uy * uy + vy * vy));
+}
+
+void footprintRange(const PerspectiveTransform& H, int width, int height, float& lo, float& hi)
+{
+	// The scale of a homography changes monotonically across the page, the corners bound it
+	const float xs[] = { 0, (float)width - 1, 0, (float)width - 1, 0.5f * (width - 1) };
+	const float ys[] = { 0, 0, (float)height - 1, (float)height - 1, 0.5f * (height - 1) };
+	lo = hi = warpFootprint(H, xs[0], ys[0]);
+	for (int i = 1; i < 5; ++i) {
+		const float f = warpFootprint(H, xs[i], ys[i]);
+		lo = min(lo, f);
+		hi = max(hi, f);
+	}
+}
+
+CImg<uchar> halfSize(const CImg<uchar>& src)
+{
+	const int w = (src.width() + 1) / 2, h = (src.height() + 1) / 2;
+	CImg<uchar> dst(w, h, 1, src.spectrum());
+	cimg_forC(src, c) {
+		for (int y = 0; y < h; ++y) {
+			const uchar* r0 = src.data(0, 2 * y, 0, c);
+			const uchar* r1 = src.data(0, min(2 * y + 1, src.height() - 1), 0, c);
+			uchar* out = dst.data(0, y, 0, c);
+			for (int x = 0; x < w; ++x) {
+				const int x0 = 2 * x, x1 = min(2 * x + 1, src.width() - 1);
+				out[x] = (uchar)((r0[x0] + r0[x1] + r1[x0] + r1[x1] + 2) >> 2);
+			}
+		}
+	}
+	return dst;
+}
+
+Matrix3 mipScale(int level)
+{
+	// Pixel centres: level l pixel i covers level 0 pixels [i 2^l, (i + 1) 2^l)
+	const float s = 1.0f / (1 << level), t = 0.5f * s - 0.5f;
+	return Matrix3(s, 0, t, 0, s, t, 0, 0, 1);
+}
+
+// Bilinear sample of one plane, borders clamped
+static inline float sampleLevel(const uchar* plane, int w, int h, float u, float v)
+{
+	u = clampCoord(u, w - 1);
+	v = clampCoord(v, h - 1);
+	const int ix = (int)u, iy = (int)v;
+	const float fx = u - ix, fy = v - iy;
+	const uchar* p = plane + iy * w + ix;
+	const int sx = ix < w - 1 ? 1 : 0, sy = iy < h - 1 ? w : 0;
+	const float top = p[0] + fx * (p[sx] - p[0]);
+	const float bottom = p[sy] + fx * (p[sy + sx] - p[sy]);
+	return top + fy * (bottom - top);
+}
+
+void warpPerspectiveMip(const CImg<uchar>& src, const PerspectiveTransform& H, CImg<uchar>& dest, int threads)
+{
+	if (dest.spectrum() != src.spectrum())
+		dest.assign(dest.width(), dest.height(), 1, src.spectrum());
+
+	float lo, hi;
+	footprintRange(H, dest.width(), dest.height(), lo, hi);
+	if (hi <= 1) {		//No minification anywhere, plain bilinear
+		warpPerspective(src, H, dest, threads);
+		return;
+	}
+
+	// Only the levels the page actually reaches
+	const int maxLevel = (int)ceil(log2(hi));
+	vector<CImg<uchar>> levels(1, src);
+	for (int l = 1; l <= maxLevel && (levels.back().width() > 1 || levels.back().height() > 1); ++l)
+		levels.push_back(halfSize(levels.back()));
+	const int top = (int)levels.size() - 1;
+
+	parallelRows(dest.height(), threads, [&](int y0, int y1) {
+		for (int y = y0; y < y1; ++y) {
+			cimg_forX(dest, x) {
+				const float d = H.a13 * x + H.a23 * y + H.a33;
+				const float u = (H.a11 * x + H.a21 * y + H.a31) / d;
+				const float v = (H.a12 * x + H.a22 * y + H.a32) / d;
+				const float lod = min((float)top, max(0.0f, log2(warpFootprint(H, x, y))));
+				const int l0 = (int)lod, l1 = min(l0 + 1, top);
+				const float f = lod - l0;
+				const float s0 = 1.0f / (1 << l0), s1 = 1.0f / (1 << l1);
+				const CImg<uchar> &m0 = levels[l0], &m1 = levels[l1];
+				cimg_forC(dest, c) {
+					float value = sampleLevel(m0.data(0, 0, 0, c), m0.width(), m0.height(),
+						(u + 0.5f) * s0 - 0.5f, (v + 0.5f) * s0 - 0.5f);
+					if (f > 0)
+						value += f * (sampleLevel(m1.data(0, 0, 0, c), m1.width(), m1.height(),
+							(u + 0.5f) * s1 - 0.5f, (v + 0.5f) * s1 - 0.5f) - value);
+					dest(x, y, 0, c) = (uchar)(value + 0.5f);
+				}
+			}
+		}
+	});
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include "PerspectiveTransform.h"
+#include <functional>
+
+// Row-stepped perspective warp: dest(x, y) = src(H(x, y)), bilinear, borders clamped like linear_atXYZC.
+// Along a row the numerators and the denominator of H grow by a constant per pixel, so 8 pixels
+// are mapped at once (SSE2 when available, sources below 32768 pixels a side). Source offsets and
+// weights are computed once per pixel and shared by every channel. Rows are split between threads, 0 uses every core.
+void warpPerspective(const CImg<uchar>& src, const PerspectiveTransform& H, CImg<uchar>& dest, int threads = 0);
+
+// Map one row of dest: offset of the top-left source pixel, steps to the right and lower
+// neighbours (0 on the last column / row) and the two interpolation weights
+void mapPerspectiveRow(const PerspectiveTransform& H, int y, int width, int srcW, int srcH,
+	int* offset, int* stepX, int* stepY, float* wx, float* wy);
+
+// Run rows(y0, y1) over [0, height) in contiguous bands, one per thread, 0 uses every core
+void parallelRows(int height, int threads, const function<void(int, int)>& rows);
+
+// Source pixels one destination pixel spans at (x, y), the longer side of the Jacobian of H
+float warpFootprint(const PerspectiveTransform& H, float x, float y);
+void footprintRange(const PerspectiveTransform& H, int width, int height, float& lo, float& hi);
+
+// Next mip level: 2x2 box average, an odd last row / column is averaged with itself
+CImg<uchar> halfSize(const CImg<uchar>& src);
+
+// Level 0 pixel coordinates to mip level coordinates
+Matrix3 mipScale(int level);
+
+// Antialiased warp for shrinking: trilinear sampling of a mip pyramid of src, the level picked per
+// pixel from the footprint of H. Only the levels the page needs are built; without minification
+// it falls back to warpPerspective.
+void warpPerspectiveMip(const CImg<uchar>& src, const PerspectiveTransform& H, CImg<uchar>& dest, int threads = 0);
@@ -0,0 +1,138 @@
+#include "RemapCache.h"
+
+RemapTable::RemapTable(const PerspectiveTransform& H, int w, int h, int outW, int outH, int threads)
+{
+	srcW = w;
+	srcH = h;
+	width = outW;
+	height = outH;
+
+	const size_t n = (size_t)width * height;
+	offset.resize(n);
+	step.resize(n);
+	wx.resize(n);
+	wy.resize(n);
+
+	const float one = 1 << WEIGHT_BITS;
+	parallelRows(height, threads, [&](int y0, int y1) {
+		vector<int> off(width), sx(width), sy(width);
+		vector<float> fx(width), fy(width);
+		for (int y = y0; y < y1; ++y) {
+			mapPerspectiveRow(H, y, width, srcW, srcH, off.data(), sx.data(), sy.data(), fx.data(), fy.data());
+			const size_t row = (size_t)y * width;
+			for (int x = 0; x < width; ++x) {
+				offset[row + x] = off[x];
+				step[row + x] = (sx[x] ? 1 : 0) | (sy[x] ? 2 : 0);
+				wx[row + x] = (uchar)(fx[x] * one + 0.5f);
+				wy[row + x] = (uchar)(fy[x] * one + 0.5f);
+			}
+		}
+	});
+}
+
+size_t RemapTable::bytes() const
+{
+	return offset.size() * sizeof(int) + step.size() + wx.size() + wy.size();
+}
+
+void RemapTable::apply(const CImg<uchar>& src, CImg<uchar>& dest, int threads) const
+{
+	dest.assign(width, height, 1, src.spectrum());
+	const int one = 1 << WEIGHT_BITS, round = 1 << (2 * WEIGHT_BITS - 1);
+	parallelRows(height, threads, [&](int y0, int y1) {
+		for (int y = y0; y < y1; ++y) {
+			const size_t row = (size_t)y * width;
+			const int* off = &offset[row];
+			const uchar *st = &step[row], *ax = &wx[row], *ay = &wy[row];
+			cimg_forC(dest, c) {
+				const uchar* plane = src.data(0, 0, 0, c);
+				uchar* out = dest.data(0, y, 0, c);
+				for (int x = 0; x < width; ++x) {
+					const uchar* p = plane + off[x];
+					const int sx = st[x] & 1, sy = (st[x] >> 1) * srcW;
+					const int top = p[0] * (one - ax[x]) + p[sx] * ax[x];
+					const int bottom = p[sy] * (one - ax[x]) + p[sy + sx] * ax[x];
+					out[x] = (uchar)((top * (one - ay[x]) + bottom * ay[x] + round) >> (2 * WEIGHT_BITS));
+				}
+			}
+		}
+	});
+}
+
+RemapCache::RemapCache(size_t bytes, int q)
+{
+	maxBytes = bytes;
+	quantum = max(1, q);
+	hits = misses = 0;
+	used = 0;
+}
+
+shared_ptr<const RemapTable> RemapCache::get(const vector<pair<int, int>>& vertex, int srcW, int srcH,
+	int width, int height, int threads, int level)
+{
+	// Snap the corners to the centre of their cell so every quad of the cell gets the same table
+	vector<pair<int, int>> snapped;
+	Key key;
+	for (auto& v : vertex) {
+		const int qx = (int)floor((double)v.first / quantum), qy = (int)floor((double)v.second / quantum);
+		snapped.push_back(make_pair(qx * quantum + quantum / 2, qy * quantum + quantum / 2));
+		key.push_back(qx);
+		key.push_back(qy);
+	}
+	key.push_back(srcW);
+	key.push_back(srcH);
+	key.push_back(width);
+	key.push_back(height);
+	key.push_back(level);
+
+	{
+		lock_guard<mutex> guard(lock);
+		auto it = index.find(key);
+		if (it != index.end()) {
+			entries.splice(entries.begin(), entries, it->second);
+			++hits;
+			return it->second->second;
+		}
+		++misses;
+	}
+
+	// Built outside the lock, two threads missing the same key both build it and the second insert is dropped
+	PerspectiveTransform P;
+	PerspectiveTransform H = P.pageTransform(snapped, width, height);
+	for (int l = 0; l < level; ++l) {
+		srcW = (srcW + 1) / 2;
+		srcH = (srcH + 1) / 2;
+	}
+	if (level > 0)
+		H = PerspectiveTransform(H.matrix().compose(mipScale(level)));
+	shared_ptr<const RemapTable> table = make_shared<RemapTable>(H, srcW, srcH, width, height, threads);
+
+	lock_guard<mutex> guard(lock);
+	if (index.find(key) == index.end()) {
+		entries.push_front(make_pair(key, table));
+		index[key] = entries.begin();
+		used += table->bytes();
+		// Evict least recently used tables, the newest one is always kept
+		while (used > maxBytes && entries.size() > 1) {
+			used -= entries.back().second->bytes();
+			index.erase(entries.back().first);
+			entries.pop_back();
+		}
+	}
+	return table;
+}
+
+double RemapCache::hitRate(size_t& lookups)
+{
+	lock_guard<mutex> guard(lock);
+	lookups = hits + misses;
+	return lookups ? (double)hits / lookups : 0;
+}
+
+void RemapCache::clear()
+{
+	lock_guard<mutex> guard(lock);
+	entries.clear();
+	index.clear();
+	used = 0;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "PerspectiveWarp.h"
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+
+// Precomputed perspective mapping of one output size: per destination pixel the offset of the
+// top-left source pixel, the right / lower neighbour flags and Q7 bilinear weights.
+// Warping a page with it is a pure gather.
+class RemapTable
+{
+public:
+	int width, height;			//Output size
+	int srcW, srcH;				//Source size the offsets refer to
+	vector<int> offset;
+	vector<uchar> step;			//Bit 0: right neighbour exists, bit 1: lower neighbour exists
+	vector<uchar> wx, wy;		//Weights of the right / lower neighbour, 0..128
+
+	static const int WEIGHT_BITS = 7;
+
+public:
+	RemapTable(const PerspectiveTransform& H, int srcW, int srcH, int width, int height, int threads = 0);
+	size_t bytes() const;
+	void apply(const CImg<uchar>& src, CImg<uchar>& dest, int threads = 0) const;
+};
+
+// LRU cache of remap tables keyed by the page corners quantized to `quantum` pixels and by the
+// source and output sizes. Pages seen at nearly the same pose share one table. Safe to use from
+// several threads.
+class RemapCache
+{
+public:
+	typedef vector<int> Key;
+
+	size_t maxBytes;			//Memory bound of all tables
+	int quantum;				//Corner quantization step in pixels
+	size_t hits, misses;
+
+private:
+	typedef list<pair<Key, shared_ptr<const RemapTable>>> Entries;
+	Entries entries;			//Most recently used first
+	map<Key, Entries::iterator> index;
+	size_t used;
+	mutex lock;
+
+public:
+	RemapCache(size_t maxBytes = 256 << 20, int quantum = 2);
+
+	// Table warping the quad vertex (top-left, top-right, bottom-left, bottom-right) of a
+	// srcW x srcH image to width x height. With level > 0 the table samples that mip level of
+	// the image (see halfSize()), the vertex stays in full resolution pixels.
+	shared_ptr<const RemapTable> get(const vector<pair<int, int>>& vertex, int srcW, int srcH,
+		int width, int height, int threads = 0, int level = 0);
+	void clear();
+	size_t bytes() const { return used; }
+	double hitRate(size_t& lookups);	//Share of get() calls that found their table
+};
@@ -0,0 +1,35 @@
+#include "BatchRectifier.h"
+
+// Usage: A4ShapeCorrect [-b] [-e] [-c] <input dir | list file | image> <output dir> [threads]
+//   -b  binarize the rectified pages
+//   -e  the inputs are edge maps already
+//   -c  fixed camera: reuse remap tables between pages at the same pose
+int main(int argc, char** argv) {
+	vector<string> args;
+	bool binarize = false, edgeInput = false, cacheRemap = false;
+	for (int i = 1; i < argc; ++i) {
+		if (string(argv[i]) == "-b")
+			binarize = true;
+		else if (string(argv[i]) == "-e")
+			edgeInput = true;
+		else if (string(argv[i]) == "-c")
+			cacheRemap = true;
+		else
+			args.push_back(argv[i]);
+	}
+	if (args.size() < 2) {
+		cout << "Usage: " << argv[0] << " [-b] [-e] [-c] <input dir | list file | image> <output dir> [threads]" << endl;
+		return 1;
+	}
+
+	cimg::exception_mode(0);	//Unreadable pages are reported, not shown
+	vector<string> files = BatchRectifier::collectInputs(args[0]);
+	BatchRectifier rectifier(args[1], args.size() > 2 ? atoi(args[2].c_str()) : 0);
+	rectifier.binarize = binarize;
+	rectifier.edgeInput = edgeInput;
+	rectifier.cacheRemap = cacheRemap;
+	rectifier.run(files);
+	rectifier.report();
+
+	return 0;
+}
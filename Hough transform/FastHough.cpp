@@ -0,0 +1,103 @@
+#include "FastHough.h"
+
+// Sums along the dyadic lines of an n-column, h-row image stored column by column
+// (cols(s, u) is pixel (u, s)), n a power of two and rows wrapping around.
+// Returns sums(s, t): the line entering column 0 at row s and rising t rows by column n - 1.
+// The merges ping-pong between cols and scratch, the result is whichever of the two is returned.
+static CImg<int>& dyadicLineSums(CImg<int>& cols, CImg<int>& scratch)
+{
+	const int h = cols.width(), n = cols.height();
+	scratch.assign(h, n);
+	CImg<int> *cur = &cols, *next = &scratch;
+
+	// Blocks of size 1 are the columns themselves; merge two blocks of size m into 2m:
+	// H_2m(t, s) = H_left(t/2, s) + H_right(t/2, s + t - t/2)
+	for (int m = 1; m < n; m *= 2) {
+		for (int b = 0; b < n; b += 2 * m) {
+			for (int t = 0; t < 2 * m; ++t) {
+				const int half = t / 2, shift = t - half;
+				const int* left = cur->data(0, b + half);
+				const int* right = cur->data(0, b + m + half);
+				int* out = next->data(0, b + t);
+				for (int s = 0; s < h - shift; ++s)
+					out[s] = left[s] + right[s + shift];
+				for (int s = h - shift; s < h; ++s)
+					out[s] = left[s] + right[s + shift - h];
+			}
+		}
+		swap(cur, next);
+	}
+	return *cur;
+}
+
+void fastHoughTransform(const CImg<uchar>& edge, int theta, double interval, int max_length,
+	CImg<int>& houghImage)
+{
+	houghImage = CImg<int>(theta, max_length, 1, 1, 0);
+
+	int N = 1;
+	while (N < edge.width() || N < edge.height())
+		N <<= 1;
+
+	// Two 2N x N int buffers shared by the four quadrants: 16 N^2 bytes, 256 MB at N = 4096
+	CImg<int> frame(2 * N, N), scratch(2 * N, N);
+
+	for (int q = 0; q < 4; ++q) {
+		// Quadrant frame (u, v) -> image (x, y): identity, flipped, transposed, transposed and flipped
+		auto toImage = [&](double u, double v, double& x, double& y) {
+			switch (q) {
+			case 0: x = u; y = v; break;
+			case 1: x = u; y = N - 1 - v; break;
+			case 2: x = v; y = u; break;
+			default: x = N - 1 - v; y = u; break;
+			}
+		};
+
+		// Stored column by column; rows N..2N-1 are zero padding, so lines may also enter
+		// column 0 above the image
+		frame.fill(0);
+		for (int u = 0; u < N; ++u) {
+			for (int v = 0; v < N; ++v) {
+				double x, y;
+				toImage(u, v, x, y);
+				if (x < edge.width() && y < edge.height() && edge((int)x, (int)y) != 0)
+					frame(v, u) = 1;
+			}
+		}
+
+		const CImg<int>& sums = dyadicLineSums(frame, scratch);
+		for (int t = 0; t < N; ++t) {
+			// Line from (0, v0) to (N - 1, v0 + t) in the quadrant frame: its direction, and so
+			// its normal and theta, depend on t only
+			double x0, y0, x1, y1;
+			toImage(0, 0, x0, y0);
+			toImage(N - 1, t, x1, y1);
+			double nx = -(y1 - y0), ny = x1 - x0;
+			double len = sqrt(nx * nx + ny * ny);
+			nx /= len;
+			ny /= len;
+			double angle = atan2(ny, nx);
+			if (angle < 0)
+				angle += 2 * cimg::PI;
+			int bin = (int)floor(angle / interval + 0.5) % theta;
+			int opposite = (int)floor((angle + cimg::PI) / interval + 0.5) % theta;	//normal flipped, rho >= 0
+
+			const int* column = sums.data(0, t);
+			for (int s = 0; s < 2 * N; ++s) {
+				int votes = column[s];
+				if (votes == 0)
+					continue;
+				double v0 = s < N ? s : s - 2 * N;
+				toImage(0, v0, x0, y0);
+				double r = nx * x0 + ny * y0;
+				int i = bin;
+				if (r < 0) {
+					r = -r;
+					i = opposite;
+				}
+				if (r < max_length && votes > houghImage(i, r))
+					houghImage(i, r) = votes;
+			}
+		}
+	}
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include "Hough.h"
+
+// Dyadic Fast Hough Transform.
+// The edge map is padded to N x N (N a power of two) and, for each of the four quadrants
+// (mostly horizontal / mostly vertical, ascending / descending), the sums along all dyadic
+// lines are built bottom-up by merging half-width blocks: O(N^2 log N) per quadrant instead
+// of O(edges x theta). Every dyadic line is then mapped back to its (theta, rho) bin, so the
+// result is the same Hough space as houghSpaceTransform and works with houghLinesDetect.
+// Needs two 2N x N int buffers: 16 N^2 bytes, 256 MB for a 4096 x 4096 pad.
+void fastHoughTransform(const CImg<uchar>& edge, int theta, double interval, int max_length,
+	CImg<int>& houghImage);
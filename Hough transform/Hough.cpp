@@ -1,33 +1,93 @@
 
 #include "Hough.h"
+#include "HoughVoting.h"
+#include "HoughCircleFFT.h"
+#include "FastHough.h"
 
 
-Hough::Hough(string filename) {
-	img.load(filename.c_str());
-
-	width = img.width();
-	height = img.height();
+void Hough::init(int w, int h)
+{
+	width = w;
+	height = h;
 	max_length = sqrt(pow(width, 2) + pow(height, 2));
+}
 
-	/*gFiltered = img.get_norm().normalize(0, 255);
-	gFiltered.blur(5);
+Hough::Hough(const CImg<uchar>& edge, const CImg<uchar>& image) {
+	init(edge.width(), edge.height());
+	gradnum = edge.get_channel(0);
+	img = image.is_empty() ? gradnum : image;
+	result = gradnum;
+	extractEdgePoints();
+}
 
-	Prewitt();*/
-	//sobel();
-	gradnum.load("./result2/Edge2.bmp");
+Hough::Hough(const EdgeList& edgeList, int w, int h) {
+	if (edgeList.y.size() != edgeList.x.size())
+		throw CImgArgumentException("Hough::Hough(): edge list has %u x and %u y coordinates.",
+			(unsigned)edgeList.x.size(), (unsigned)edgeList.y.size());
+	init(w, h);
+	gradnum = CImg<uchar>(w, h, 1, 1, 0);
+	for (size_t k = 0; k < edgeList.size(); ++k) {
+		const int x = edgeList.x[k], y = edgeList.y[k];
+		if (x < 0 || x >= w || y < 0 || y >= h)
+			throw CImgArgumentException("Hough::Hough(): edge point (%d,%d) is outside the %dx%d image.", x, y, w, h);
+		gradnum(x, y) = 255;
+	}
+	img = gradnum;
 	result = gradnum;
+	edges = edgeList;
+}
 
+Hough::Hough(const CImg<float>& gradient, double threshold) {
+	init(gradient.width(), gradient.height());
+	// One channel is the magnitude, two channels are (gx, gy)
+	CImg<float> mag = gradient.spectrum() >= 2 ?
+		(gradient.get_channel(0).sqr() + gradient.get_channel(1).sqr()).sqrt() : gradient.get_channel(0);
+	gradnum = CImg<uchar>(width, height, 1, 1, 0);
+	cimg_forXY(mag, x, y) {
+		if (mag(x, y) > threshold)
+			gradnum(x, y) = mag(x, y) > 255 ? 255 : mag(x, y);
+	}
+	img = gradnum;
+	result = gradnum;
+	extractEdgePoints();
+
+	edges.mag.resize(edges.size());
+	if (gradient.spectrum() >= 2)
+		edges.dir.resize(edges.size());
+	for (size_t k = 0; k < edges.size(); ++k) {
+		int x = edges.x[k], y = edges.y[k];
+		edges.mag[k] = mag(x, y);
+		if (gradient.spectrum() >= 2)
+			edges.dir[k] = atan2(gradient(x, y, 0, 1), gradient(x, y, 0, 0));
+	}
+}
 
-	/*houghSpaceTransform();
+vector<HoughLine> Hough::detectLines()
+{
+	peaks.clear();
+	houghSpaceTransform();
 	houghLinesDetect();
-	drawLines();
-	drawPoints();
-	result.save("./result1/6.bmp");*/
 
+	vector<HoughLine> found;
+	for (auto& p : peaks) {
+		found.push_back(HoughLine(p.x, p.y, houghImage(p.x, p.y)));
+	}
+	return found;
+}
 
-	houghCircleTransform();
-	result.save("./result2/2.bmp");
+vector<Segment> Hough::detectSegments()
+{
+	houghProbabilisticTransform();
+	return segments;
+}
 
+vector<HoughCircle> Hough::detectCircles()
+{
+	circles.clear();
+	circleWeight.clear();
+	center.clear();
+	houghCircleTransform();
+	return center;
 }
 
 void Hough::sobel()
@@ -64,8 +124,8 @@ void Hough::sobel()
 			double sumx = 0;
 			double sumy = 0;
 
-			for (int x = 0; x < xFilter.size(); x++)
-				for (int y = 0; y < yFilter.size(); y++)
+			for (int x = 0; x < (int)xFilter.size(); x++)
+				for (int y = 0; y < (int)yFilter.size(); y++)
 				{
 					sumx += yFilter[x][y] * (double)(gFiltered(i + x - size, j + y - size)); //Sobel_X Filter Value
 					sumy += xFilter[x][y] * (double)(gFiltered(i + x - size, j + y - size)); //Sobel_Y Filter Value
@@ -105,21 +165,264 @@ void Hough::Prewitt()
 	
 }
 
+void Hough::extractEdgePoints(bool withGradient)
+{
+	edges.clear();
+	cimg_forXY(gradnum, x, y) {
+		if (gradnum(x, y) != 0) {
+			edges.x.push_back(x);
+			edges.y.push_back(y);
+		}
+	}
+
+	if (!withGradient)
+		return;
+
+	// Central differences at the edge pixels only, on the smoothed image when there is one
+	CImg<float> src = gFiltered.is_empty() ? CImg<float>(gradnum) : gFiltered;
+	edges.dir.resize(edges.size());
+	edges.mag.resize(edges.size());
+	for (size_t k = 0; k < edges.size(); ++k) {
+		int x = edges.x[k], y = edges.y[k];
+		float gx = (src.atXY(x + 1, y, 0, 0, 0) - src.atXY(x - 1, y, 0, 0, 0)) / 2;
+		float gy = (src.atXY(x, y + 1, 0, 0, 0) - src.atXY(x, y - 1, 0, 0, 0)) / 2;
+		edges.dir[k] = atan2(gy, gx);
+		edges.mag[k] = sqrt(gx * gx + gy * gy);
+	}
+}
+
 void Hough::houghSpaceTransform()
 {
 	houghImage = CImg<int>(theta, max_length, 1, 1, 0);
 
-	cimg_forXY(gradnum, x, y) {
-		int temp = gradnum(x, y);
-		if (temp != 0) {
-			for (int i = 0; i < theta; ++i) {
-				double r = x * cos(i*interval) + y * sin(i*interval);
-				if (r >= 0 && r < max_length) {
-					houghImage(i, r)++;		//voting
+	for (size_t k = 0; k < edges.size(); ++k) {
+		int x = edges.x[k], y = edges.y[k];
+		for (int i = 0; i < theta; ++i) {
+			double r = x * cos(i*interval) + y * sin(i*interval);
+			if (r >= 0 && r < max_length) {
+				houghImage(i, r)++;		//voting
+			}
+		}
+	}
+}
+
+// Same (theta, rho) space as houghSpaceTransform, voted with the blocked fixed-point kernel
+void Hough::houghSpaceTransformBlocked()
+{
+	voteLinesBlocked(edges, theta, interval, max_length, houghImage);
+}
+
+// Same (theta, rho) space as houghSpaceTransform, from the dyadic Fast Hough Transform
+void Hough::houghSpaceTransformFast()
+{
+	fastHoughTransform(gradnum, theta, interval, max_length, houghImage);
+}
+
+// Occupied cells of the edge map downsampled by scale, each cell listed once
+EdgeList Hough::downsampleEdges(int scale)
+{
+	EdgeList coarse;
+	CImg<uchar> mark(gradnum.width() / scale + 1, gradnum.height() / scale + 1, 1, 1, 0);
+	for (size_t k = 0; k < edges.size(); ++k) {
+		int cx = edges.x[k] / scale, cy = edges.y[k] / scale;
+		if (mark(cx, cy) == 0) {
+			mark(cx, cy) = 1;
+			coarse.x.push_back(cx);
+			coarse.y.push_back(cy);
+		}
+	}
+	return coarse;
+}
+
+// Bins above minVotes that are not smaller than any of their 8 neighbours
+vector<Point> Hough::accumulatorPeaks(const CImg<int>& acc, int minVotes)
+{
+	vector<Point> found;
+	cimg_forXY(acc, x, y) {
+		int v = acc(x, y);
+		if (v <= minVotes)
+			continue;
+		bool isMax = true;
+		for (int dy = -1; dy <= 1 && isMax; ++dy)
+			for (int dx = -1; dx <= 1 && isMax; ++dx)
+				if (acc.atXY(x + dx, y + dy, 0, 0, 0) > v)
+					isMax = false;
+		if (isMax)
+			found.push_back(Point(x, y));
+	}
+	return found;
+}
+
+// Vote on the downsampled edge map with scale-times coarser rho bins, then re-vote at
+// full resolution only in the (theta, rho) windows around the coarse peaks. Theta keeps its
+// resolution: a coarser angle smears long lines over many rho bins and loses them.
+void Hough::houghSpaceTransformCoarseToFine(int scale)
+{
+	EdgeList coarse = downsampleEdges(scale);
+	int coarseLength = max_length / scale + 1;
+	vector<double> tabCos(theta), tabSin(theta);
+	for (int i = 0; i < theta; ++i) {
+		tabCos[i] = cos(i*interval);
+		tabSin[i] = sin(i*interval);
+	}
+
+	CImg<int> coarseImage(theta, coarseLength, 1, 1, 0);
+	for (size_t k = 0; k < coarse.size(); ++k) {
+		int x = coarse.x[k], y = coarse.y[k];
+		for (int i = 0; i < theta; ++i) {
+			double r = x * tabCos[i] + y * tabSin[i];
+			if (r >= 0 && r < coarseLength) {
+				coarseImage(i, r)++;		//voting
+			}
+		}
+	}
+
+	// A coarse peak is off by up to one theta bin and about 1.5 rho bins from the line
+	CImg<uchar> active(theta, max_length, 1, 1, 0);
+	for (auto& p : accumulatorPeaks(coarseImage, min_votes / scale)) {
+		for (int t = p.x - 1; t <= p.x + 1; ++t) {
+			int i = (t + theta) % theta;
+			for (int r = max(0, (p.y - 2) * scale); r < min(max_length, (p.y + 3) * scale); ++r)
+				active(i, r) = 1;
+		}
+	}
+	vector<int> activeTheta;
+	for (int i = 0; i < theta; ++i) {
+		if (active.get_column(i).max() != 0)
+			activeTheta.push_back(i);
+	}
+
+	houghImage = CImg<int>(theta, max_length, 1, 1, 0);
+	for (size_t k = 0; k < edges.size(); ++k) {
+		int x = edges.x[k], y = edges.y[k];
+		for (int i : activeTheta) {
+			double r = x * tabCos[i] + y * tabSin[i];
+			if (r >= 0 && r < max_length && active(i, r)) {
+				houghImage(i, r)++;		//voting
+			}
+		}
+	}
+}
+
+void Hough::houghProbabilisticTransform()
+{
+	houghImage = CImg<int>(theta, max_length, 1, 1, 0);
+	segments.clear();
+
+	vector<double> tabCos(theta), tabSin(theta);
+	for (int i = 0; i < theta; ++i) {
+		tabCos[i] = cos(i*interval);
+		tabSin[i] = sin(i*interval);
+	}
+
+	// 0: no edge, 1: edge not voted yet, 2: edge already voted
+	CImg<uchar> mask(gradnum.width(), gradnum.height(), 1, 1, 0);
+	vector<int> order(edges.size());
+	for (size_t k = 0; k < edges.size(); ++k) {
+		mask(edges.x[k], edges.y[k]) = 1;
+		order[k] = k;
+	}
+
+	// Random voting order, fixed seed so that runs are repeatable
+	mt19937 rng(0);
+	shuffle(order.begin(), order.end(), rng);
+
+	auto vote = [&](int x, int y, int delta) {
+		for (int i = 0; i < theta; ++i) {
+			double r = x * tabCos[i] + y * tabSin[i];
+			if (r >= 0 && r < max_length) {
+				houghImage(i, r) += delta;
+			}
+		}
+	};
+
+	vector<pair<int, int>> path[2];		//Edge pixels met on each side of the walk
+	for (size_t n = 0; n < order.size() && (int)segments.size() < max_segments; ++n) {
+		int x = edges.x[order[n]], y = edges.y[order[n]];
+		if (mask(x, y) != 1)	//removed together with an earlier segment
+			continue;
+		mask(x, y) = 2;
+
+		int best = 0, bestTheta = 0, bestRho = 0;
+		for (int i = 0; i < theta; ++i) {
+			double r = x * tabCos[i] + y * tabSin[i];
+			if (r >= 0 && r < max_length) {
+				int votes = ++houghImage(i, r);		//voting
+				if (votes > best) {
+					best = votes;
+					bestTheta = i;
+					bestRho = r;
+				}
+			}
+		}
+		if (best < ppht_threshold)
+			continue;
+
+		// Walk along the line through (x, y), one pixel per step on the major axis. The 1 degree bin
+		// drifts off a long shallow line, so an edge one pixel across the line is taken as well and
+		// the walk carries on from it
+		double dx = -tabSin[bestTheta], dy = tabCos[bestTheta];
+		double step = max(fabs(dx), fabs(dy));
+		dx /= step;
+		dy /= step;
+		const int cx = fabs(dx) >= fabs(dy) ? 0 : 1, cy = 1 - cx;		//One pixel across the line
+
+		int endX[2] = { x, x }, endY[2] = { y, y };
+		for (int k = 0; k < 2; ++k) {
+			double sx = k == 0 ? dx : -dx, sy = k == 0 ? dy : -dy;
+			int gap = 0, shift = 0;
+			path[k].clear();
+			for (int s = 1;; ++s) {
+				int px = (int)floor(x + s * sx + 0.5) + shift * cx, py = (int)floor(y + s * sy + 0.5) + shift * cy;
+				if (px < 0 || px >= mask.width() || py < 0 || py >= mask.height())
+					break;
+				int side = 0;
+				if (mask(px, py) == 0) {
+					for (int c = -1; c <= 1 && side == 0; c += 2) {
+						int qx = px + c * cx, qy = py + c * cy;
+						if (qx >= 0 && qx < mask.width() && qy >= 0 && qy < mask.height() && mask(qx, qy) != 0)
+							side = c;
+					}
+					px += side * cx;
+					py += side * cy;
+					shift += side;
+				}
+				if (mask(px, py) != 0) {
+					gap = 0;
+					endX[k] = px;
+					endY[k] = py;
+					path[k].push_back(make_pair(px, py));
+				}
+				else if (++gap > max_line_gap) {
+					break;
 				}
 			}
 		}
+
+		if (distance(endX[0] - endX[1], endY[0] - endY[1]) < min_line_length)
+			continue;
+
+		// Remove the segment's pixels, with the ones across the line the walk could have taken,
+		// and take back the votes they already cast
+		auto remove = [&](int px, int py) {
+			for (int c = -1; c <= 1; ++c) {
+				int qx = px + c * cx, qy = py + c * cy;
+				if (qx < 0 || qx >= mask.width() || qy < 0 || qy >= mask.height())
+					continue;
+				if (mask(qx, qy) == 2)
+					vote(qx, qy, -1);
+				mask(qx, qy) = 0;
+			}
+		};
+		remove(x, y);
+		for (int k = 0; k < 2; ++k) {
+			for (auto& p : path[k])
+				remove(p.first, p.second);
+		}
+		segments.push_back(Segment(endX[0], endY[0], endX[1], endY[1], bestTheta, bestRho));
 	}
+	if (verbose)
+		cout << segments.size() << endl;
 }
 
 double Hough::distance(double x, double y) {
@@ -144,14 +447,14 @@ void Hough::houghLinesDetect()
 			}
 		}
 	}
-	cout << peaks.size() << endl;
-
+	if (verbose)
+		cout << peaks.size() << endl;
 }
 
 void Hough::drawLines()
 {
 	lines.clear();
-	for (int i = 0; i < peaks.size(); i++) {
+	for (size_t i = 0; i < peaks.size(); i++) {
 		double theta = double(peaks[i].x)*interval;
 		double k = -cos(theta) / sin(theta); // ֱб
 		if (peaks[i].x == 90|| peaks[i].x == 270)
@@ -166,7 +469,7 @@ void Hough::drawLines()
 	result = img;
 
 	const double lines_color[] = { 0, 0, 255 };
-	for (int i = 0; i < lines.size(); i++) {
+	for (size_t i = 0; i < lines.size(); i++) {
 		const int x0 = (y_min - lines[i].b) / lines[i].k;
 		const int x1 = (y_max - lines[i].b) / lines[i].k;
 		const int x = peaks[i].y / cos(peaks[i].x*interval);
@@ -191,18 +494,20 @@ void Hough::drawLines()
 
 void Hough::drawPoints()
 {
-	for (int i = 0; i < peaks.size(); ++i) {
+	for (size_t i = 0; i < peaks.size(); ++i) {
 		//cout << "vote: " << houghImage(peaks[i].x, peaks[i].y) << endl;
-		cout << "vote: " << peaks[i].x<<" "<<peaks[i].y << endl;
+		if (verbose)
+			cout << "vote: " << peaks[i].x<<" "<<peaks[i].y << endl;
 
 		double angle = peaks[i].x*interval;
 		double a0 = cos(angle), b0 = sin(angle), c0 = -peaks[i].y;
 		//cout <<"Peaks "<< peaks[i].x << " "<<peaks[i].y << endl;
 		if (peaks[i].x == 90)
 			a0 = 0;
-		cout << "Line"<<i<< ": ( "<< a0 <<" ) x + (" << b0 << ") y + ( "<< c0 <<" ) = 0"<< endl;
+		if (verbose)
+			cout << "Line"<<i<< ": ( "<< a0 <<" ) x + (" << b0 << ") y + ( "<< c0 <<" ) = 0"<< endl;
 
-		for (int j = i + 1; j < peaks.size(); ++j) {
+		for (size_t j = i + 1; j < peaks.size(); ++j) {
 			double angle1 = peaks[j].x*interval;
 			double a1 = cos(angle1), b1 = sin(angle1), c1 = -peaks[j].y;
 			if (peaks[j].x == 90|| peaks[j].x == 270)
@@ -221,46 +526,99 @@ void Hough::drawPoints()
 		}
 	}
 
-	cout << "Points:" << endl;
+	if (verbose)
+		cout << "Points:" << endl;
 
 	for (auto c : points) {
 		const double color[] = { 255,0,0 };
-		cout << "( " << c.x << " , " << c.y << " )" << endl;
+		if (verbose)
+			cout << "( " << c.x << " , " << c.y << " )" << endl;
 		result.draw_circle(c.x, c.y, 20, color);
 	}
 }
 
+void Hough::drawSegments()
+{
+	result = img;
+
+	const double lines_color[] = { 0, 0, 255 };
+	for (auto& s : segments) {
+		if (verbose)
+			cout << "Segment: ( " << s.x0 << " , " << s.y0 << " ) - ( " << s.x1 << " , " << s.y1 << " )" << endl;
+		result.draw_line(s.x0, s.y0, s.x1, s.y1, lines_color);
+	}
+}
+
 
 void Hough::houghCircleTransform()
 {
 	int max;
 	vector<Point> voteSet;
+	HoughAccumulator::Storage storage = HoughAccumulator::choose(width, height, edges.size(), theta);
 	for (int r = minR; r < maxR; r++) {
 		max = 0;
-		houghImage = CImg<int>(width, height, 1, 1, 0);
-		cimg_forXY(gradnum, x, y) {
-			int value = gradnum(x, y);
-			if (value != 0) {
-				for (int i = 0; i < theta; i++) {
-					//x0 y0ΪԲ
-					int x0 = x - r * cos(i*interval);
-					int y0 = y - r * sin(i*interval);
-					/*votingͶƱ*/
-					if (x0 > 0 && x0 < width && y0 > 0 && y0 < height) {
-						houghImage(x0, y0)++;
-					}
+		circleVotes.assign(width, height, storage);
+		for (size_t k = 0; k < edges.size(); ++k) {
+			int x = edges.x[k], y = edges.y[k];
+			for (int i = 0; i < theta; i++) {
+				//x0 y0ΪԲ
+				int x0 = x - r * cos(i*interval);
+				int y0 = y - r * sin(i*interval);
+				/*votingͶƱ*/
+				if (x0 > 0 && x0 < width && y0 > 0 && y0 < height) {
+					circleVotes.vote(x0, y0);
 				}
 			}
 		}
 		/*ÿαrҵhoughͶƱͶƱʾǰrǺϳ̶ȣȻͶƱrΪõr*/
-		cimg_forXY(houghImage, x, y) {
-			if (houghImage(x, y) > max) {
-				max = houghImage(x, y);
+		max = circleVotes.max();
+		if (max > rLimit) {
+			voteSet.push_back(Point(max, r));
+			//cout << max << " " << r << endl;
+		}
+	}
+
+	sort(voteSet.begin(), voteSet.end(), [](const Point& a, const Point& b) -> bool {
+		return a.x > b.x;
+	});
+
+	for (size_t i = 0; i < voteSet.size(); i++) {
+		circleVotes.assign(width, height, storage);
+		for (size_t k = 0; k < edges.size(); ++k) {
+			int x = edges.x[k], y = edges.y[k];
+			for (int j = 0; j < theta; j++) {
+				int x0 = x - voteSet[i].y * cos(j*interval);
+				int y0 = y - voteSet[i].y * sin(j*interval);
+				/*votingͶƱ*/
+				if (x0 > 0 && x0 < width && y0 > 0 && y0 < height) {
+					circleVotes.vote(x0, y0);
+				}
 			}
 		}
+		houghCirclesDetect();
+		pickCircle(voteSet[i].y);
+	}
+	if (verbose)
+		cout << "ԲĸΪ" << center.size() << endl;
+}
+
+// Circle detection for a known set of radii, center votes computed by FFT correlation
+void Hough::houghCircleTransformFFT(const vector<int>& radii, HoughCircleFFT* cache)
+{
+	if (radii.empty())
+		return;
+	HoughCircleFFT local(theta, interval);
+	HoughCircleFFT& circleFFT = cache ? *cache : local;	//ring spectra are only kept across images in a given cache
+	circleFFT.setEdgeMap(gradnum, *max_element(radii.begin(), radii.end()));
+
+	vector<Point> voteSet;
+	map<int, CImg<int>> votes;
+	for (int r : radii) {
+		CImg<int> v = circleFFT.centerVotes(r);
+		int max = v.max();
 		if (max > rLimit) {
 			voteSet.push_back(Point(max, r));
-			//cout << max << " " << r << endl;
+			votes[r] = v;
 		}
 	}
 
@@ -268,52 +626,227 @@ void Hough::houghCircleTransform()
 		return a.x > b.x;
 	});
 
-	for (int i = 0; i < voteSet.size(); i++) {
-		houghImage = CImg<int>(width, height, 1, 1, 0);
-		cimg_forXY(gradnum, x, y) {
-			int value = gradnum(x, y);
-			if (value != 0) {
-				for (int j = 0; j < theta; j++) {
-					int x0 = x - voteSet[i].y * cos(j*interval);
-					int y0 = y - voteSet[i].y * sin(j*interval);
-					/*votingͶƱ*/
-					if (x0 > 0 && x0 < width && y0 > 0 && y0 < height) {
-						houghImage(x0, y0)++;
-					}
+	for (size_t i = 0; i < voteSet.size(); i++) {
+		circleVotes.adopt(votes[voteSet[i].y]);
+		houghCirclesDetect();
+		pickCircle(voteSet[i].y);
+	}
+	if (verbose)
+		cout << center.size() << endl;
+}
+
+// Center votes of radius r, counted only for centers inside the given windows
+void Hough::voteCircleInWindows(int r, const vector<Box>& windows)
+{
+	circleVotes.assign(width, height, HoughAccumulator::choose(width, height, edges.size(), theta));
+	if (windows.empty())
+		return;
+
+	CImg<uchar> inWindow(width, height, 1, 1, 0);
+	int bx0 = width, by0 = height, bx1 = 0, by1 = 0;
+	for (auto& w : windows) {
+		const uchar one[] = { 1 };
+		inWindow.draw_rectangle(w.x0, w.y0, w.x1, w.y1, one);
+		bx0 = min(bx0, w.x0); by0 = min(by0, w.y0);
+		bx1 = max(bx1, w.x1); by1 = max(by1, w.y1);
+	}
+
+	for (size_t k = 0; k < edges.size(); ++k) {
+		int x = edges.x[k], y = edges.y[k];
+		// Only edge pixels within r of some window can vote into it
+		if (x < bx0 - r - 1 || x > bx1 + r + 1 || y < by0 - r - 1 || y > by1 + r + 1)
+			continue;
+		for (int i = 0; i < theta; i++) {
+			int x0 = x - r * cos(i*interval);
+			int y0 = y - r * sin(i*interval);
+			if (x0 > 0 && x0 < width && y0 > 0 && y0 < height && inWindow(x0, y0)) {
+				circleVotes.vote(x0, y0);
+			}
+		}
+	}
+}
+
+// Find radius and center candidates on the downsampled edge map, then vote at full
+// resolution only for radii and centers in windows around them
+void Hough::houghCircleTransformCoarseToFine(int scale)
+{
+	EdgeList coarse = downsampleEdges(scale);
+	int coarseW = width / scale + 1, coarseH = height / scale + 1;
+	int coarseTheta = theta / scale;	//the ring is scale times shorter on the coarse map
+
+	map<int, vector<Box>> windows;		//full resolution radius -> center windows
+	for (int cr = minR / scale; cr <= (maxR - 1) / scale; cr++) {
+		CImg<int> coarseImage(coarseW, coarseH, 1, 1, 0);
+		for (size_t k = 0; k < coarse.size(); ++k) {
+			int x = coarse.x[k], y = coarse.y[k];
+			for (int i = 0; i < coarseTheta; i++) {
+				int x0 = x - cr * cos(i*scale*interval);
+				int y0 = y - cr * sin(i*scale*interval);
+				if (x0 > 0 && x0 < coarseW && y0 > 0 && y0 < coarseH) {
+					coarseImage(x0, y0)++;
 				}
 			}
 		}
+		for (auto& p : accumulatorPeaks(coarseImage, rLimit / scale)) {
+			Box w((p.x - 1) * scale, (p.y - 1) * scale, (p.x + 2) * scale, (p.y + 2) * scale);
+			for (int r = max(minR, (cr - 1) * scale); r <= min(maxR - 1, (cr + 1) * scale); r++)
+				windows[r].push_back(w);
+		}
+	}
+
+	vector<Point> voteSet;
+	for (auto& rw : windows) {
+		voteCircleInWindows(rw.first, rw.second);
+		int max = circleVotes.max();
+		if (max > rLimit) {
+			voteSet.push_back(Point(max, rw.first));
+		}
+	}
+
+	sort(voteSet.begin(), voteSet.end(), [](const Point& a, const Point& b) -> bool {
+		return a.x > b.x;
+	});
+
+	for (size_t i = 0; i < voteSet.size(); i++) {
+		voteCircleInWindows(voteSet[i].y, windows[voteSet[i].y]);
 		houghCirclesDetect();
-		drawCircle(voteSet[i].y);
+		pickCircle(voteSet[i].y);
+	}
+	if (verbose)
+		cout << center.size() << endl;
+}
+
+// Ring samples of (x, y, r) that fall on an edge pixel or next to one, out of the samples
+// inside the image
+int Hough::circleSupport(int x, int y, int r, int& inside)
+{
+	int count = 0;
+	inside = 0;
+	for (int i = 0; i < theta; i++) {
+		int px = (int)floor(x + r * cos(i*interval) + 0.5);
+		int py = (int)floor(y + r * sin(i*interval) + 0.5);
+		if (px < 0 || px >= gradnum.width() || py < 0 || py >= gradnum.height())
+			continue;
+		inside++;
+		if (gradnum(px, py) || gradnum.atXY(px - 1, py, 0, 0, 0) || gradnum.atXY(px + 1, py, 0, 0, 0) ||
+			gradnum.atXY(px, py - 1, 0, 0, 0) || gradnum.atXY(px, py + 1, 0, 0, 0))
+			count++;
+	}
+	return count;
+}
+
+// Randomized Hough: every sample of three edge points (or two, when gradient directions are
+// known) gives one circle, which votes into a small hash of (x, y, r) cells. A cell that gets
+// rht_threshold hits is checked against the edge map; a confirmed circle is stored and its
+// edge pixels leave the sampling pool. Memory does not depend on image size or radius range.
+void Hough::houghCircleTransformRandomized()
+{
+	const bool useGradient = edges.dir.size() == edges.size() && edges.size() > 0;
+	vector<int> pool(edges.size());
+	for (size_t k = 0; k < edges.size(); ++k)
+		pool[k] = k;
+
+	center.clear();
+	mt19937 rng(0);
+	unordered_map<long long, int> cells;
+	const size_t samples = useGradient ? 2 : 3;	//With gradients two points give the center
+	for (int iter = 0; iter < rht_max_iterations && (int)center.size() < rht_max_circles; ++iter) {
+		if (pool.size() < samples)
+			break;
+		uniform_int_distribution<size_t> pick(0, pool.size() - 1);
+		int p = pool[pick(rng)], q = pool[pick(rng)];
+		if (p == q)
+			continue;
+		double x1 = edges.x[p], y1 = edges.y[p];
+		double x2 = edges.x[q], y2 = edges.y[q];
+		// Points of one circle are at most a diameter apart
+		if (distance(x2 - x1, y2 - y1) > 2 * maxR)
+			continue;
+
+		double cx, cy;
+		if (useGradient) {
+			// Center where the two gradient lines meet
+			double c1 = cos(edges.dir[p]), s1 = sin(edges.dir[p]);
+			double c2 = cos(edges.dir[q]), s2 = sin(edges.dir[q]);
+			double D = c1 * s2 - s1 * c2;
+			if (fabs(D) < 1e-3)
+				continue;
+			double t = ((x2 - x1) * s2 - (y2 - y1) * c2) / D;
+			cx = x1 + t * c1;
+			cy = y1 + t * s1;
+		}
+		else {
+			int s = pool[pick(rng)];
+			if (s == p || s == q)
+				continue;
+			double x3 = edges.x[s], y3 = edges.y[s];
+			if (distance(x3 - x1, y3 - y1) > 2 * maxR)
+				continue;
+			// Circumcenter of the three points
+			double D = 2 * (x1 * (y2 - y3) + x2 * (y3 - y1) + x3 * (y1 - y2));
+			if (fabs(D) < 1e-6)
+				continue;
+			double n1 = x1 * x1 + y1 * y1, n2 = x2 * x2 + y2 * y2, n3 = x3 * x3 + y3 * y3;
+			cx = (n1 * (y2 - y3) + n2 * (y3 - y1) + n3 * (y1 - y2)) / D;
+			cy = (n1 * (x3 - x2) + n2 * (x1 - x3) + n3 * (x2 - x1)) / D;
+		}
+		int a = (int)floor(cx + 0.5), b = (int)floor(cy + 0.5);
+		int r = (int)floor(distance(x1 - cx, y1 - cy) + 0.5);
+		if (r < minR || r >= maxR || a <= 0 || a >= width || b <= 0 || b >= height)
+			continue;
+
+		if (cells.size() >= rht_max_cells)
+			cells.clear();
+		long long key = ((long long)r * height + b) * width + a;
+		if (++cells[key] < rht_threshold)
+			continue;
+		cells.erase(key);
+
+		int inside;
+		int support = circleSupport(a, b, r, inside);
+		if (inside == 0 || support < rht_min_support * inside)
+			continue;
+
+		bool known = false;
+		for (auto& c : center) {
+			if (distance(c.x - a, c.y - b) < minRadius && abs(c.r - r) < minRadius)
+				known = true;
+		}
+		if (!known)
+			center.push_back(HoughCircle(a, b, r, support));
+
+		// Edge pixels on the confirmed ring no longer take part in sampling
+		vector<int> rest;
+		for (int k : pool) {
+			if (fabs(distance(edges.x[k] - a, edges.y[k] - b) - r) > 2)
+				rest.push_back(k);
+		}
+		pool.swap(rest);
+		cells.clear();
 	}
-	cout << "ԲĸΪ" << center.size() << endl;
 }
 
 void Hough::houghCirclesDetect()
 {
 	/*ͼвΪ0ĵӦԲĵ*/
-	cimg_forXY(houghImage, x, y) {
-		if (houghImage(x, y) > voteLimit) {
-			circles.push_back(Point(x, y));
-			circleWeight.push_back(houghImage(x, y));
-		}
+	for (auto& v : circleVotes.above(voteLimit)) {
+		circles.push_back(Point(v.x, v.y));
+		circleWeight.push_back(v.votes);
 	}
 	//cout << circles.size() << endl;
 }
 
 
-void Hough::drawCircle(int r)
+void Hough::pickCircle(int r)
 {
 	int count = 0;
-	unsigned char blue[3] = { 0, 0, 255 };
-	unsigned char red[3] = { 255, 0, 0 };
 
 	auto sortCircleWeight = circleWeight;
 	sort(sortCircleWeight.begin(), sortCircleWeight.end(), greater<int>()); // ۼӾӴС
 
 	while (1) {
 
-		if (count >= sortCircleWeight.size())
+		if (count >= (int)sortCircleWeight.size())
 			break;
 
 		int weight = sortCircleWeight[count], index;
@@ -323,19 +856,29 @@ void Hough::drawCircle(int r)
 		count++;
 		//cout << "count: " << count << endl;
 
-		int i;
+		size_t i;
 		for (i = 0; i < center.size(); i++) {
 			if (distance(center[i].x - a, center[i].y - b) < minRadius) {
 				break; // жϼԲǷѼԲľ룬СĬͬԲ
 			}
 		}
 		if (i == center.size()) {
-			center.push_back(Point(a, b));
-			cout << "Բİ뾶Ϊ" << r << endl;
-			cout << "ԲΪ"<< a << " " << b << endl;
-			result.draw_circle(a, b, r, blue, 5.0f, 1);
-			result.draw_circle(a, b, 5, red);
+			center.push_back(HoughCircle(a, b, r, weight));
+			if (verbose) {
+				cout << "Բİ뾶Ϊ" << r << endl;
+				cout << "ԲΪ"<< a << " " << b << endl;
+			}
 			break;
 		}
 	}
+}
+
+void Hough::drawCircles()
+{
+	unsigned char blue[3] = { 0, 0, 255 };
+	unsigned char red[3] = { 255, 0, 0 };
+	for (auto& c : center) {
+		result.draw_circle(c.x, c.y, c.r, blue, 5.0f, 1);
+		result.draw_circle(c.x, c.y, 5, red);
+	}
 }
\ No newline at end of file
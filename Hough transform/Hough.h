@@ -0,0 +1,175 @@
+#pragma once
+#include "CImg.h"
+#include "HoughAccumulator.h"
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <cmath>
+#include <random>
+#include <map>
+#include <unordered_map>
+
+using namespace cimg_library;
+using namespace std;
+typedef unsigned char uchar;
+
+class HoughCircleFFT;
+
+struct Point {
+	int x, y;
+	Point(int a, int b) {
+		x = a;
+		y = b;
+	}
+};
+
+// y = k * x + b
+struct Line {
+	double k, b;
+	Line(double a, double c) {
+		k = a;
+		b = c;
+	}
+};
+
+// Finite line segment with its (theta, rho) bin
+struct Segment {
+	int x0, y0, x1, y1;
+	int theta, rho;
+	Segment(int a0, int b0, int a1, int b1, int t, int r) {
+		x0 = a0; y0 = b0;
+		x1 = a1; y1 = b1;
+		theta = t; rho = r;
+	}
+};
+
+// Detected line: x * cos(theta * interval) + y * sin(theta * interval) = rho
+struct HoughLine {
+	int theta, rho;
+	int votes;
+	HoughLine(int t, int r, int v) {
+		theta = t; rho = r;
+		votes = v;
+	}
+};
+
+// Detected circle
+struct HoughCircle {
+	int x, y, r;
+	int votes;
+	HoughCircle(int a, int b, int c, int v) {
+		x = a; y = b; r = c;
+		votes = v;
+	}
+};
+
+// Axis-aligned window, both corners included
+struct Box {
+	int x0, y0, x1, y1;
+	Box(int a0, int b0, int a1, int b1) {
+		x0 = a0; y0 = b0;
+		x1 = a1; y1 = b1;
+	}
+};
+
+// Edge pixels of the edge map, stored as a structure of arrays
+struct EdgeList {
+	vector<int> x, y;
+	vector<float> dir, mag;		//Gradient direction (radian) and magnitude, only filled on request
+
+	size_t size() const { return x.size(); }
+	void clear() {
+		x.clear(); y.clear();
+		dir.clear(); mag.clear();
+	}
+};
+
+class Hough
+{
+public:
+	CImg<uchar> img;			//Original Image
+	CImg<float> gFiltered;		//Gaussian Filtered
+	CImg<uchar> gradnum;		//Edge Map
+	CImg<int> houghImage;		//Hough Space of lines
+	HoughAccumulator circleVotes;	//Center votes of one radius
+	CImg<uchar> result;			//Result Image
+	EdgeList edges;				//Non-zero pixels of gradnum
+
+	int width, height;
+	int max_length;				//Length of the image diagonal
+
+	vector<Point> peaks;		//(theta, rho) of detected lines
+	vector<Line> lines;
+	vector<Point> points;		//Intersection of lines
+	vector<Segment> segments;	//Probabilistic Hough segments
+
+	vector<Point> circles;		//Candidate circle centers
+	vector<int> circleWeight;	//Votes of candidate circle centers
+	vector<HoughCircle> center;	//Detected circles
+
+	const int theta = 360;
+	const double interval = cimg::PI / 180;
+	const double gradLimit = 20;
+	const int min_votes = 250;
+	const double min_distance = 50;
+
+	const int minR = 150, maxR = 250;
+	const int rLimit = 150;
+	const int voteLimit = 150;
+	const double minRadius = 50;
+
+	// Randomized circle Hough
+	int rht_max_iterations = 100000;	//Samples drawn at most
+	int rht_threshold = 3;				//Hits of a (x, y, r) cell before it is checked on the edges
+	double rht_min_support = 0.6;		//Share of the ring that must lie on edges
+	int rht_max_circles = 10;			//Stop once this many circles are found
+	size_t rht_max_cells = 4096;		//Candidate cells kept at most
+
+	// Progressive probabilistic Hough
+	int ppht_threshold = 50;		//Votes needed to extract a segment
+	int min_line_length = 50;		//Shorter segments are dropped
+	int max_line_gap = 5;			//Largest gap bridged along a segment
+	int max_segments = 20;			//Stop once this many segments are found
+
+	bool verbose = false;			//Print the detected lines, points and circles
+
+private:
+	void init(int, int);
+
+public:
+	explicit Hough(const CImg<uchar>& edge, const CImg<uchar>& image = CImg<uchar>());	//Edge map, image to draw on
+	Hough(const EdgeList& edgeList, int width, int height);								//Edge pixels, all inside width x height
+	Hough(const CImg<float>& gradient, double threshold);								//Gradient magnitude, or (gx, gy)
+	template<typename T> explicit Hough(const CImg<T>&) = delete;		//A non-uchar image needs the gradient threshold
+
+	vector<HoughLine> detectLines();
+	vector<Segment> detectSegments();
+	vector<HoughCircle> detectCircles();
+
+	void sobel();
+	void Prewitt();
+	void extractEdgePoints(bool withGradient = false);
+	EdgeList downsampleEdges(int);
+	vector<Point> accumulatorPeaks(const CImg<int>&, int);
+	void houghSpaceTransform();
+	void houghSpaceTransformBlocked();
+	void houghSpaceTransformCoarseToFine(int scale = 4);
+	void houghSpaceTransformFast();
+	void houghProbabilisticTransform();
+	double distance(double, double);
+	void houghLinesDetect();
+	void drawLines();
+	void drawPoints();
+	void drawSegments();
+	void houghCircleTransform();
+	void houghCircleTransformFFT(const vector<int>& radii, HoughCircleFFT* cache = nullptr);	//Ring spectra kept in cache across images
+	void houghCircleTransformCoarseToFine(int scale = 4);
+	void voteCircleInWindows(int, const vector<Box>&);
+	void houghCircleTransformRandomized();
+	int circleSupport(int, int, int, int&);
+	void houghCirclesDetect();
+	void pickCircle(int);
+	void drawCircles();
+};
@@ -0,0 +1,129 @@
+#include "HoughAccumulator.h"
+
+HoughAccumulator::HoughAccumulator() : w(0), h(0), storage(DENSE32) {}
+
+HoughAccumulator::Storage HoughAccumulator::choose(int w, int h, size_t voters, int samples)
+{
+	// A hash entry costs about 8 times a uint16 bin, so go sparse when at most 1/8 of the
+	// bins can receive a vote
+	double totalVotes = (double)voters * samples;
+	if (totalVotes * 8 < (double)w * h)
+		return SPARSE;
+	// Each edge point puts about one vote in a bin, so more than 65535 voters can overflow uint16
+	// and start in int32 rather than pay for a promotion halfway through; below that a bin only
+	// overflows when a small ring samples it several times, and vote() promotes then
+	if (voters > 65535)
+		return DENSE32;
+	return DENSE16;
+}
+
+void HoughAccumulator::assign(int width, int height, Storage s)
+{
+	w = width;
+	h = height;
+	storage = s;
+	dense16.assign();
+	dense32.assign();
+	sparse.clear();
+	switch (storage) {
+	case DENSE16:
+		dense16.assign(w, h, 1, 1, 0);
+		break;
+	case DENSE32:
+		dense32.assign(w, h, 1, 1, 0);
+		break;
+	case SPARSE:
+		break;
+	}
+}
+
+void HoughAccumulator::adopt(CImg<int>& votes)
+{
+	assign(0, 0, DENSE32);
+	w = votes.width();
+	h = votes.height();
+	dense32.swap(votes);
+}
+
+void HoughAccumulator::promote()
+{
+	dense32 = dense16;
+	dense16.assign();
+	storage = DENSE32;
+}
+
+size_t HoughAccumulator::bytes() const
+{
+	switch (storage) {
+	case DENSE16:
+		return dense16.size() * sizeof(unsigned short);
+	case DENSE32:
+		return dense32.size() * sizeof(int);
+	default:
+		return sparse.size() * (sizeof(long long) + sizeof(int) + 2 * sizeof(void*));
+	}
+}
+
+int HoughAccumulator::at(int x, int y) const
+{
+	switch (storage) {
+	case DENSE16:
+		return dense16(x, y);
+	case DENSE32:
+		return dense32(x, y);
+	default: {
+		auto it = sparse.find((long long)y * w + x);
+		return it == sparse.end() ? 0 : it->second;
+	}
+	}
+}
+
+int HoughAccumulator::max() const
+{
+	int m = 0;
+	switch (storage) {
+	case DENSE16:
+		if (!dense16.is_empty())
+			m = dense16.max();
+		break;
+	case DENSE32:
+		if (!dense32.is_empty())
+			m = std::max(0, dense32.max());
+		break;
+	case SPARSE:
+		for (auto& kv : sparse)
+			m = std::max(m, kv.second);
+		break;
+	}
+	return m;
+}
+
+vector<Bin> HoughAccumulator::above(int threshold) const
+{
+	vector<Bin> found;
+	switch (storage) {
+	case DENSE16:
+		cimg_forXY(dense16, x, y) {
+			if (dense16(x, y) > threshold)
+				found.push_back(Bin(x, y, dense16(x, y)));
+		}
+		break;
+	case DENSE32:
+		cimg_forXY(dense32, x, y) {
+			if (dense32(x, y) > threshold)
+				found.push_back(Bin(x, y, dense32(x, y)));
+		}
+		break;
+	case SPARSE:
+		for (auto& kv : sparse) {
+			if (kv.second > threshold)
+				found.push_back(Bin((int)(kv.first % w), (int)(kv.first / w), kv.second));
+		}
+		// Same order as the dense scans, so peak selection does not depend on the storage
+		sort(found.begin(), found.end(), [](const Bin& a, const Bin& b) -> bool {
+			return a.y != b.y ? a.y < b.y : a.x < b.x;
+		});
+		break;
+	}
+	return found;
+}
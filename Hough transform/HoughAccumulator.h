@@ -0,0 +1,73 @@
+#pragma once
+#include "CImg.h"
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+using namespace cimg_library;
+using namespace std;
+
+// One accumulator bin with its votes
+struct Bin {
+	int x, y;
+	int votes;
+	Bin(int a, int b, int v) {
+		x = a; y = b;
+		votes = v;
+	}
+};
+
+// 2D vote accumulator whose storage is chosen from the expected vote counts: a hash of the
+// non-zero bins for sparse edge maps, int32 dense when there are enough voters to overflow a
+// uint16 bin, uint16 dense otherwise. A uint16 accumulator is still promoted to int32 as soon
+// as one bin would overflow.
+class HoughAccumulator
+{
+public:
+	enum Storage { DENSE16, DENSE32, SPARSE };
+
+private:
+	int w, h;
+	Storage storage;
+	CImg<unsigned short> dense16;
+	CImg<int> dense32;
+	unordered_map<long long, int> sparse;	//y * w + x -> votes
+
+	void promote();
+
+public:
+	HoughAccumulator();
+
+	// voters edge points casting samples votes each over a w x h grid
+	static Storage choose(int w, int h, size_t voters, int samples);
+
+	void assign(int w, int h, Storage s);
+	void adopt(CImg<int>& votes);				//Take over a dense int32 vote image
+	Storage type() const { return storage; }
+	size_t bytes() const;
+
+	inline void vote(int x, int y) {
+		switch (storage) {
+		case DENSE16: {
+			unsigned short& v = dense16(x, y);
+			if (v == 65535) {
+				promote();
+				dense32(x, y)++;
+			}
+			else {
+				v++;
+			}
+		} break;
+		case DENSE32:
+			dense32(x, y)++;
+			break;
+		case SPARSE:
+			sparse[(long long)y * w + x]++;
+			break;
+		}
+	}
+
+	int at(int x, int y) const;
+	int max() const;
+	vector<Bin> above(int threshold) const;		//Bins with more votes than threshold, in raster order
+};
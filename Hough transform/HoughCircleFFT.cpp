@@ -0,0 +1,88 @@
+#include "HoughCircleFFT.h"
+
+static int nextPow2(int n)
+{
+	int p = 1;
+	while (p < n)
+		p <<= 1;
+	return p;
+}
+
+HoughCircleFFT::HoughCircleFFT(int t, double i, size_t bytes) :
+	width(0), height(0), padW(0), padH(0), used(0), theta(t), interval(i), maxBytes(bytes) {}
+
+void HoughCircleFFT::setEdgeMap(const CImg<uchar>& edge, int maxR)
+{
+	width = edge.width();
+	height = edge.height();
+	// Room for the ring to hang over the border without wrapping back into the image
+	padW = nextPow2(width + maxR + 1);
+	padH = nextPow2(height + maxR + 1);
+
+	CImg<float> real(padW, padH, 1, 1, 0);
+	cimg_forXY(edge, x, y) {
+		if (edge(x, y) != 0)
+			real(x, y) = 1;
+	}
+	edgeSpectrum = real.get_FFT();
+}
+
+const CImgList<float>& HoughCircleFFT::ringSpectrum(int r)
+{
+	Key key(make_pair(padW, padH), r);
+	auto it = index.find(key);
+	if (it != index.end()) {
+		ringSpectra.splice(ringSpectra.begin(), ringSpectra, it->second);
+		return it->second->second;
+	}
+
+	// A voting edge pixel p gives center p - d, d = (ceil(r cos), ceil(r sin)), so the votes of
+	// a center c are the sum of edge(c + d) over the ring: a correlation with this kernel.
+	CImg<float> ring(padW, padH, 1, 1, 0);
+	for (int i = 0; i < theta; i++) {
+		int dx = (int)ceil(r * cos(i*interval) - 1e-9);
+		int dy = (int)ceil(r * sin(i*interval) - 1e-9);
+		ring((dx + padW) % padW, (dy + padH) % padH) += 1;
+	}
+	ringSpectra.push_front(make_pair(key, ring.get_FFT()));
+	index[key] = ringSpectra.begin();
+	used += 2 * (size_t)padW * padH * sizeof(float);
+	// Evict the least recently used, always keeping the new one
+	while (used > maxBytes && ringSpectra.size() > 1) {
+		const Key& old = ringSpectra.back().first;
+		used -= 2 * (size_t)old.first.first * old.first.second * sizeof(float);
+		index.erase(old);
+		ringSpectra.pop_back();
+	}
+	return ringSpectra.front().second;
+}
+
+CImg<int> HoughCircleFFT::centerVotes(int r)
+{
+	const CImgList<float>& K = ringSpectrum(r);
+	const CImgList<float>& E = edgeSpectrum;
+
+	// E * conj(K)
+	CImg<float> real(padW, padH), imag(padW, padH);
+	cimg_forXY(real, x, y) {
+		float a = E[0](x, y), b = E[1](x, y), c = K[0](x, y), d = K[1](x, y);
+		real(x, y) = a * c + b * d;
+		imag(x, y) = b * c - a * d;
+	}
+	CImg<float>::FFT(real, imag, true);
+
+	CImg<int> votes(width, height, 1, 1, 0);
+	cimg_forXY(votes, x, y) {
+		// Same border rule as the voting loop
+		if (x > 0 && y > 0)
+			votes(x, y) = (int)floor(real(x, y) + 0.5);
+	}
+	return votes;
+}
+
+void HoughCircleFFT::clearCache()
+{
+	ringSpectra.clear();
+	index.clear();
+	used = 0;
+}
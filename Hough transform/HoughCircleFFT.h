@@ -0,0 +1,43 @@
+#pragma once
+#include "CImg.h"
+#include <map>
+#include <list>
+#include <utility>
+#include <cmath>
+
+using namespace cimg_library;
+using namespace std;
+typedef unsigned char uchar;
+
+// Circle center voting for a fixed set of radii, done as a correlation of the edge map
+// with a ring kernel per radius in the Fourier domain. Gives the same center votes as the
+// per-radius voting loop of houghCircleTransform. Ring spectra depend only on the padded
+// size and the radius, so they are cached and reused for every image of the same size; the
+// cache is LRU and bounded by maxBytes (a 4096 x 4096 pad takes 128 MB per radius).
+// Not safe to share between threads, use one instance per thread.
+class HoughCircleFFT
+{
+private:
+	int width, height;				//Size of the current edge map
+	int padW, padH;					//Power of two FFT size
+	CImgList<float> edgeSpectrum;	//FFT of the current edge map
+
+	typedef pair<pair<int, int>, int> Key;	//(padW, padH), r
+	typedef list<pair<Key, CImgList<float>>> Entries;
+	Entries ringSpectra;			//FFT of the rings, most recently used first
+	map<Key, Entries::iterator> index;
+	size_t used;					//Bytes of the cached spectra
+
+	const CImgList<float>& ringSpectrum(int r);
+
+public:
+	int theta;						//Samples on the ring, as in the voting loop
+	double interval;
+	size_t maxBytes;				//Memory bound of the cached ring spectra
+
+	HoughCircleFFT(int theta, double interval, size_t maxBytes = 512 << 20);
+	void setEdgeMap(const CImg<uchar>& edge, int maxR);	//Transform a new edge map once
+	CImg<int> centerVotes(int r);						//Center votes for radius r
+	void clearCache();
+	size_t bytes() const { return used; }
+};
@@ -0,0 +1,101 @@
+#include "HoughVoting.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define HOUGH_USE_SSE2
+#endif
+
+static const int FIXED_SHIFT = 14;			// cos/sin in Q14
+static const int BLOCK_SIZE = 2048;			// points per block, 8 KB of packed (x, y)
+static const int FLUSH_LIMIT = 65535;		// votes a uint16 counter can take between flushes
+static const int MAX_COORD = 32767;			// largest coordinate an int16 (x, y) pair can hold
+
+// Plain voting with int coordinates, for images too large for the packed kernel
+static void voteLinesScalar(const EdgeList& edges, int theta, double interval, int max_length,
+	CImg<int>& houghImage)
+{
+	vector<double> tabCos(theta), tabSin(theta);
+	for (int i = 0; i < theta; ++i) {
+		tabCos[i] = cos(i*interval);
+		tabSin[i] = sin(i*interval);
+	}
+	for (size_t k = 0; k < edges.size(); ++k) {
+		int x = edges.x[k], y = edges.y[k];
+		for (int i = 0; i < theta; ++i) {
+			double r = x * tabCos[i] + y * tabSin[i];
+			if (r >= 0 && r < max_length)
+				houghImage(i, (int)r)++;		//voting
+		}
+	}
+}
+
+// Add the uint16 stripes to the (theta, rho) accumulator and clear them
+static void flushStripes(CImg<unsigned short>& stripes, CImg<int>& houghImage)
+{
+	cimg_forXY(stripes, r, i) {
+		houghImage(i, r) += stripes(r, i);
+	}
+	stripes.fill(0);
+}
+
+void voteLinesBlocked(const EdgeList& edges, int theta, double interval, int max_length,
+	CImg<int>& houghImage)
+{
+	houghImage = CImg<int>(theta, max_length, 1, 1, 0);
+	for (size_t k = 0; k < edges.size(); ++k) {
+		if (edges.x[k] > MAX_COORD || edges.y[k] > MAX_COORD || edges.x[k] < 0 || edges.y[k] < 0) {
+			voteLinesScalar(edges, theta, interval, max_length, houghImage);
+			return;
+		}
+	}
+	CImg<unsigned short> stripes(max_length, theta, 1, 1, 0);
+
+	// (cos, sin) of every theta packed as two int16 in one int32, matching the (x, y) layout
+	vector<int> tabCos(theta), tabSin(theta), tabCS(theta);
+	for (int i = 0; i < theta; ++i) {
+		tabCos[i] = (int)floor(cos(i*interval) * (1 << FIXED_SHIFT) + 0.5);
+		tabSin[i] = (int)floor(sin(i*interval) * (1 << FIXED_SHIFT) + 0.5);
+		tabCS[i] = (int)(((unsigned)tabCos[i] & 0xffff) | ((unsigned)tabSin[i] << 16));
+	}
+
+	vector<short> xy(2 * BLOCK_SIZE);
+	const int n = (int)edges.size();
+	int pending = 0;	// points voted since the last flush, bounds every counter
+	for (int start = 0; start < n; start += BLOCK_SIZE) {
+		const int count = min(BLOCK_SIZE, n - start);
+		if (pending + count > FLUSH_LIMIT) {
+			flushStripes(stripes, houghImage);
+			pending = 0;
+		}
+		for (int k = 0; k < count; ++k) {
+			xy[2 * k] = (short)edges.x[start + k];
+			xy[2 * k + 1] = (short)edges.y[start + k];
+		}
+
+		for (int i = 0; i < theta; ++i) {
+			unsigned short* stripe = stripes.data(0, i);
+			int k = 0;
+#ifdef HOUGH_USE_SSE2
+			const __m128i cs = _mm_set1_epi32(tabCS[i]);
+			alignas(16) int rho[8];
+			for (; k + 8 <= count; k += 8) {
+				__m128i p0 = _mm_loadu_si128((const __m128i*)&xy[2 * k]);
+				__m128i p1 = _mm_loadu_si128((const __m128i*)&xy[2 * k + 8]);
+				_mm_store_si128((__m128i*)rho, _mm_srai_epi32(_mm_madd_epi16(p0, cs), FIXED_SHIFT));
+				_mm_store_si128((__m128i*)(rho + 4), _mm_srai_epi32(_mm_madd_epi16(p1, cs), FIXED_SHIFT));
+				for (int m = 0; m < 8; ++m) {
+					if ((unsigned)rho[m] < (unsigned)max_length)
+						stripe[rho[m]]++;		//voting
+				}
+			}
+#endif
+			for (; k < count; ++k) {
+				int r = (xy[2 * k] * tabCos[i] + xy[2 * k + 1] * tabSin[i]) >> FIXED_SHIFT;
+				if ((unsigned)r < (unsigned)max_length)
+					stripe[r]++;		//voting
+			}
+		}
+		pending += count;
+	}
+	flushStripes(stripes, houghImage);
+}
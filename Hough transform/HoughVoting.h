@@ -0,0 +1,11 @@
+#pragma once
+#include "Hough.h"
+
+// Cache-blocked line voting.
+// Edge points are packed as int16 (x, y) pairs in blocks; for every theta the rho of
+// 8 points is computed at once in Q14 fixed point (SSE2 when available) and counted in
+// a theta-major uint16 stripe that stays in cache. The stripes are promoted into the
+// int accumulator before any counter can overflow. Edge lists with a coordinate of
+// 32768 or more are voted by a plain scalar loop instead.
+void voteLinesBlocked(const EdgeList& edges, int theta, double interval, int max_length,
+	CImg<int>& houghImage);
@@ -0,0 +1,165 @@
+#include "IncrementalHough.h"
+
+IncrementalHough::IncrementalHough(int w, int h, int votes, double distance) :
+	width(w), height(h), dirty(false), min_votes(votes), min_distance(distance), changed(0)
+{
+	max_length = sqrt(pow(width, 2) + pow(height, 2));
+	tabCos.resize(theta);
+	tabSin.resize(theta);
+	for (int i = 0; i < theta; ++i) {
+		tabCos[i] = cos(i*interval);
+		tabSin[i] = sin(i*interval);
+	}
+	reset();
+}
+
+void IncrementalHough::reset()
+{
+	previous = CImg<uchar>(width, height, 1, 1, 0);
+	previousEdges.clear();
+	previousListed = true;
+	stamp = CImg<int>(width, height, 1, 1, 0);
+	frame = 0;
+	houghImage = CImg<int>(theta, max_length, 1, 1, 0);
+	above.clear();
+	lines.clear();
+	dirty = false;
+	changed = 0;
+}
+
+void IncrementalHough::vote(int x, int y, int delta)
+{
+	for (int i = 0; i < theta; ++i) {
+		double r = x * tabCos[i] + y * tabSin[i];
+		if (r >= 0 && r < max_length) {
+			int& v = houghImage(i, r);
+			bool wasAbove = v > min_votes;
+			v += delta;		//voting
+			bool isAbove = v > min_votes;
+			if (wasAbove || isAbove) {
+				dirty = true;
+				if (!wasAbove)
+					above.insert((int)r * theta + i);
+				else if (!isAbove)
+					above.erase((int)r * theta + i);
+			}
+		}
+	}
+}
+
+void IncrementalHough::extractPeaks()
+{
+	// Raster order of the accumulator, as houghLinesDetect scans it
+	vector<int> bins(above.begin(), above.end());
+	sort(bins.begin(), bins.end());
+
+	vector<Point> peaks;
+	for (int b : bins) {
+		int x = b % theta, y = b / theta;
+		bool flag = false;
+		for (auto& c : peaks) {
+			if (sqrt(pow(c.x - x, 2) + pow(c.y - y, 2)) < min_distance) {
+				flag = true;
+				if (houghImage(x, y) > houghImage(c.x, c.y)) {
+					c = Point(x, y);
+				}
+			}
+		}
+		if (!flag) {
+			peaks.push_back(Point(x, y));
+		}
+	}
+
+	lines.clear();
+	for (auto& p : peaks) {
+		lines.push_back(HoughLine(p.x, p.y, houghImage(p.x, p.y)));
+	}
+	dirty = false;
+}
+
+vector<HoughLine> IncrementalHough::update(const EdgeList& edges)
+{
+	// Pixels of this frame get this frame's stamp, so the previous frame's pixels without it are gone
+	frame++;
+	next.clear();
+	appeared.clear();
+	disappeared.clear();
+	for (size_t k = 0; k < edges.size(); ++k) {
+		int x = edges.x[k], y = edges.y[k];
+		if (x < 0 || y < 0 || x >= width || y >= height || stamp(x, y) == frame)
+			continue;
+		stamp(x, y) = frame;
+		next.x.push_back(x);
+		next.y.push_back(y);
+		if (!previous(x, y)) {
+			appeared.x.push_back(x);
+			appeared.y.push_back(y);
+		}
+	}
+	if (previousListed) {
+		for (size_t k = 0; k < previousEdges.size(); ++k) {
+			int x = previousEdges.x[k], y = previousEdges.y[k];
+			if (stamp(x, y) != frame) {
+				disappeared.x.push_back(x);
+				disappeared.y.push_back(y);
+			}
+		}
+	}
+	else {
+		// Changes were handed in directly since the last list, look at every pixel once
+		cimg_forXY(previous, x, y) {
+			if (previous(x, y) && stamp(x, y) != frame) {
+				disappeared.x.push_back(x);
+				disappeared.y.push_back(y);
+			}
+		}
+	}
+	update(appeared, disappeared);
+	swap(previousEdges, next);
+	previousListed = true;
+	return lines;
+}
+
+vector<HoughLine> IncrementalHough::update(const CImg<uchar>& edge)
+{
+	if (edge.width() != width || edge.height() != height)
+		throw CImgArgumentException("IncrementalHough::update(): edge map is %dx%d, expected %dx%d.",
+			edge.width(), edge.height(), width, height);
+	EdgeList edges;
+	cimg_forXY(edge, x, y) {
+		if (edge(x, y) != 0) {
+			edges.x.push_back(x);
+			edges.y.push_back(y);
+		}
+	}
+	return update(edges);
+}
+
+vector<HoughLine> IncrementalHough::update(const EdgeList& appeared, const EdgeList& disappeared)
+{
+	changed = 0;
+	previousListed = false;
+	for (size_t k = 0; k < disappeared.size(); ++k) {
+		int x = disappeared.x[k], y = disappeared.y[k];
+		if (x < 0 || y < 0 || x >= width || y >= height)
+			continue;
+		if (previous(x, y)) {
+			vote(x, y, -1);
+			previous(x, y) = 0;
+			changed++;
+		}
+	}
+	for (size_t k = 0; k < appeared.size(); ++k) {
+		int x = appeared.x[k], y = appeared.y[k];
+		if (x < 0 || y < 0 || x >= width || y >= height)
+			continue;
+		if (!previous(x, y)) {
+			vote(x, y, 1);
+			previous(x, y) = 1;
+			changed++;
+		}
+	}
+	if (dirty)
+		extractPeaks();
+	return lines;
+}
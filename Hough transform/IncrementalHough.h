@@ -0,0 +1,42 @@
+#pragma once
+#include "Hough.h"
+#include <unordered_set>
+
+// Line Hough for video: the (theta, rho) accumulator is kept between frames and only
+// edge pixels that appeared (+1) or disappeared (-1) since the previous frame vote.
+// The main path takes the frame's edge list and costs O(edges of this and the previous
+// frame); the edge map overload has to scan every pixel to build that list.
+// The bins above min_votes are tracked while voting, so re-extracting the peaks only
+// looks at those bins. Peaks are the same as houghSpaceTransform + houghLinesDetect.
+class IncrementalHough
+{
+private:
+	int width, height, max_length;
+	CImg<uchar> previous;				//Edge pixels of the previous frame, 0 or 1
+	EdgeList previousEdges;				//The same pixels as a list, when known
+	bool previousListed;				//previousEdges matches previous
+	CImg<int> stamp;					//Frame number that last listed each pixel
+	int frame;
+	EdgeList next, appeared, disappeared;	//Scratch lists of update(edges)
+	CImg<int> houghImage;				//Hough Space
+	vector<double> tabCos, tabSin;
+	unordered_set<int> above;			//rho * theta + theta of bins above min_votes
+	bool dirty;							//A bin in 'above' changed since the last extraction
+	vector<HoughLine> lines;
+
+	void vote(int x, int y, int delta);
+	void extractPeaks();
+
+public:
+	const int theta = 360;
+	const double interval = cimg::PI / 180;
+	const int min_votes;
+	const double min_distance;
+	size_t changed;						//Edge pixels that changed in the last update
+
+	IncrementalHough(int width, int height, int min_votes = 250, double min_distance = 50);
+	vector<HoughLine> update(const EdgeList& edges);							//Edge pixels of the next frame
+	vector<HoughLine> update(const CImg<uchar>& edge);							//Next edge map, same size
+	vector<HoughLine> update(const EdgeList& appeared, const EdgeList& disappeared);	//Known changes
+	void reset();
+};
@@ -2,7 +2,19 @@
 
 int main()
 {
-	Hough hough("./Dataset2/2.bmp");
+	CImg<uchar> img("./Dataset2/2.bmp");
+	CImg<uchar> edge("./result2/Edge2.bmp");
+	Hough hough(edge, img);
+	hough.verbose = true;
+
+	/*hough.detectLines();
+	hough.drawLines();
+	hough.drawPoints();
+	hough.result.save("./result1/6.bmp");*/
+
+	hough.detectCircles();
+	hough.drawCircles();
+	hough.result.save("./result2/2.bmp");
 
 	return 0;
-}
\ No newline at end of file
+}
@@ -2,6 +2,10 @@
 #include "CImg.h"
 #include <iostream>
 #include <vector>
+#include <thread>
+#include <atomic>
+#include <unordered_map>
+#include <algorithm>
 
 using namespace cimg_library;
 using namespace std;
@@ -21,21 +25,92 @@ public:
 	Point5D(float, float, float, float, float);					// Set point value
 	void PointLab();											// Scale the Lab color to Lab range
 	void PointRGB();											// Sclae the Lab color to range that can be used to transform to RGB
-	void MSPoint5DAccum(Point5D);								// Accumulate points
-	float MSPoint5DColorDistance(Point5D);						// Compute color space distance between two points
-	float MSPoint5DSpatialDistance(Point5D);					// Compute spatial space distance between two points
+	void MSPoint5DAccum(const Point5D&);						// Accumulate points
+	float MSPoint5DColorDistance(const Point5D&) const;			// Compute color space distance between two points
+	float MSPoint5DColorDistance2(const Point5D&) const;		// Squared color space distance, to compare with hr * hr
+	float MSPoint5DSpatialDistance(const Point5D&) const;		// Compute spatial space distance between two points
 	void MSPoint5DScale(float);									// Scale point
 	
 	void Print();												// Print 5D point
 };
 
+// Lab color of every pixel, one contiguous array per channel, converted once per image
+class LabImage {
+public:
+	int width;
+	int height;
+	vector<float> L;			// 0 to 100
+	vector<float> A;			// about -128 to 127
+	vector<float> B;			// about -128 to 127
+public:
+	void assign(const CImg<>&);									// Convert a RGB image
+	void resize(int, int);										// Set the size, the arrays only grow
+	int index(int x, int y) const { return y * width + x; }
+};
+
+// Connected region of the segmentation
+class MSRegion {
+public:
+	int Area;					// Number of pixels
+	int Left, Top, Right, Bottom;	// Bounding box, both ends included
+	float L, A, B;				// Mean Lab color
+public:
+	MSRegion(int, int);									// Region starting at a pixel, empty
+	void add(int, int, float, float, float);			// Add a pixel, its color summed until finish()
+	void finish();										// Turn the color sums into the mean
+	void merge(const MSRegion&);						// Take in another finished region
+	float ColorDistance2(const MSRegion&) const;		// Squared distance of the mean colors
+};
+
+// Buffers of MSSegmentation, kept between calls and only grown when a larger image arrives
+class MSWorkspace {
+public:
+	LabImage Lab;				// Lab color of the image, filtered
+	LabImage Filtered;			// Second buffer of the double-buffered filter
+	vector<int> Labels;			// Region of each pixel, row major
+	vector<MSRegion> Regions;	// Stats of each region
+	vector<uchar> Assigned;		// Pixels already given a mode by the accelerated filter
+	LabImage Small;				// Multi-resolution: the image shrunk Scale times, filtered
+	vector<int> Coarse;			// Multi-resolution: labels of the shrunk image
+	vector<pair<int, int> > Edges;	// Region merging: adjacent regions
+	vector<int> Parent;			// Region merging: union-find over the regions
+	vector<int> Nearest;		// Region merging: nearest colored neighbour, then new numbers
+	vector<float> NearestDistance;	// Region merging: squared color distance to it
+public:
+	void assign(int, int);		// Size the buffers for a cols x rows image
+	size_t bytes() const;		// Memory held by the buffers
+};
+
+// Converged mode of each visited cell of the 5D space, for the accelerated filter
+typedef unordered_map<unsigned long long, Point5D> MSModeCells;
+
 class MeanShift
 {
 public:
+	// The color bandwidth is a distance in CIE Lab (L 0 to 100, a and b about -128 to 127). Before the
+	// Lab conversion it was measured on RGB merely shifted into those ranges, where the same color step
+	// comes out about twice as long on average: an hr tuned for that needs halving.
+	// Regions used to grow 8-connected while within hr of their first pixel; they now chain neighbours
+	// within hr / 2 of each other. Small regions are only merged away when MinRegion is set, 0 by default
 	MeanShift(float ,float);		// Constructor for spatial bandwidth and color bandwidth
-	void MSSegmentation(CImg<>&);									// Mean Shift Segmentation
+	const vector<MSRegion>& MSSegmentation(CImg<>&);				// Mean Shift Segmentation, with the own workspace
+	const vector<MSRegion>& MSSegmentation(CImg<>&, MSWorkspace&);	// Mean Shift Segmentation, with a given workspace
+	void MSFilter(LabImage&, LabImage&, vector<uchar>&, float);		// Mean Shift Filtering of a Lab image, with a spatial radius
+	void MSSegmentCoarse(MSWorkspace&, int);						// Segment at 1 / scale, labels refined at full size
+	void MSLabelRegions(const LabImage&, MSWorkspace&);				// Connected regions and their stats
+	void MSMergeSmallRegions(const LabImage&, MSWorkspace&, int);	// Merge regions below a number of pixels
+	Point5D MSFilterPoint(const LabImage&, int, int, float);		// Converged point of one pixel
+	void MSFilterBand(const LabImage&, LabImage&, vector<uchar>&, int, int, float, MSModeCells&, vector<Point5D>&);	// Accelerated filtering of some rows
+	unsigned long long MSCellKey(const Point5D&, float) const;		// Cell of a 5D point
+	int MSWindowSum(const LabImage&, int, int, int, int, const Point5D&, Point5D&);	// Sum of the window points within hr
 
 	float hs;			//spatial radius
 	float hr;			//color radius
+	bool InPlace;		//filter in place, in raster order, on one thread
+	int Threads;		//filtering threads, 0 for all cores
+	bool Accelerated;	//reuse the modes of converged cells and trajectories, not with InPlace
+	int MinRegion;		//regions with fewer pixels merge into a neighbour, 0 (default) to keep them all
+	int Scale;			//filter and label at 1 / Scale of the size (2 to 4), 1 for full size; clamped into 1 to 4
+	MSWorkspace Workspace;	//buffers reused by every call
 };
 